@@ -0,0 +1,250 @@
+// acl_frag.c - ACL fragmentation to the controller MTU for BT dongle
+//
+// Ownership: everything but the USB transfer counters lives on Core 0. The
+// TX drain (CYW43 lock held) records each host packet's fragment count per
+// handle; the CYW43 packet handler, which that lock excludes, consumes the
+// records as the controller reports completed fragments. Controller packets
+// of one handle complete in order, so a FIFO per handle is enough.
+#include "acl_frag.h"
+#include "btstack.h"
+#include "hardware/sync.h"
+#include "pico.h"
+#include <string.h>
+
+#define ACL_FRAG_MAX_LINKS 8
+#define ACL_FRAG_PENDING 32 // Per link, power of 2; caps host_bufs
+#define ACL_FRAG_NO_HANDLE 0xFFFF
+#define USB_BULK_PACKET 64
+
+// HCI
+#define HCI_EVT_DISCONN_COMPLETE 0x05
+#define HCI_EVT_COMMAND_COMPLETE 0x0E
+#define HCI_EVT_NUM_COMPLETED_PACKETS 0x13
+#define HCI_OPCODE_READ_BUFFER_SIZE 0x1005
+
+typedef struct {
+  uint16_t handle;
+  uint8_t head;
+  uint8_t tail;
+  uint16_t done; // Completed fragments of the packet at tail
+  uint16_t frags[ACL_FRAG_PENDING];
+} frag_link_t;
+
+// Core 0
+static frag_link_t links[ACL_FRAG_MAX_LINKS];
+static uint16_t ctrl_mtu = 0;
+static uint16_t ctrl_bufs = 0;
+static uint16_t host_mtu = 0;
+static uint16_t host_bufs = 0;
+static uint16_t frag_mtu = 0; // Non-zero while fragmenting
+static uint32_t host_pkts = 0;
+static uint32_t host_bytes = 0;
+static uint32_t split = 0;
+static uint32_t fragments = 0;
+static uint32_t untracked = 0;
+
+// Core 1
+static volatile uint32_t usb_xfers = 0;
+static volatile uint32_t usb_pkts = 0;
+
+static volatile bool reset_req = false;
+
+static inline uint16_t rd16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+static inline void wr16(uint8_t *p, uint16_t v) {
+  p[0] = v & 0xFF;
+  p[1] = v >> 8;
+}
+
+static void clear_links(void) {
+  memset(links, 0, sizeof(links));
+  for (int i = 0; i < ACL_FRAG_MAX_LINKS; i++)
+    links[i].handle = ACL_FRAG_NO_HANDLE;
+}
+
+void acl_frag_init(void) {
+  clear_links();
+  ctrl_mtu = ctrl_bufs = host_mtu = host_bufs = frag_mtu = 0;
+  reset_req = false;
+}
+
+void acl_frag_reset(void) { reset_req = true; }
+
+static inline void __not_in_flash_func(apply_reset)(void) {
+  if (!reset_req)
+    return;
+  reset_req = false;
+  clear_links();
+  ctrl_mtu = ctrl_bufs = host_mtu = host_bufs = frag_mtu = 0;
+}
+
+static frag_link_t *__not_in_flash_func(find_link)(uint16_t handle) {
+  for (int i = 0; i < ACL_FRAG_MAX_LINKS; i++) {
+    if (links[i].handle == handle)
+      return &links[i];
+  }
+  return NULL;
+}
+
+// --- Core 0: RX path ---
+
+// Command Complete for Read Buffer Size: status, ACL length (2), SCO length,
+// ACL buffers (2), SCO buffers (2)
+static void __not_in_flash_func(read_buffer_size)(uint8_t *packet,
+                                                  uint16_t size) {
+  if (size < 13 || rd16(&packet[3]) != HCI_OPCODE_READ_BUFFER_SIZE ||
+      packet[5] != 0)
+    return;
+  ctrl_mtu = rd16(&packet[6]);
+  ctrl_bufs = rd16(&packet[9]);
+  host_mtu = ctrl_mtu;
+  host_bufs = ctrl_bufs;
+  frag_mtu = 0;
+  if (!DONGLE_ACL_FRAG || ctrl_mtu == 0 || ctrl_mtu >= ACL_FRAG_HOST_MTU)
+    return;
+
+  // Fragments per largest host packet, bounded by the controller's buffers
+  uint16_t per = (ACL_FRAG_HOST_MTU + ctrl_mtu - 1) / ctrl_mtu;
+  if (per > ctrl_bufs)
+    per = ctrl_bufs;
+  if (per < 2)
+    return;
+  host_mtu = per * ctrl_mtu < ACL_FRAG_HOST_MTU ? per * ctrl_mtu
+                                                : ACL_FRAG_HOST_MTU;
+  host_bufs = ctrl_bufs / per;
+  if (host_bufs > ACL_FRAG_PENDING)
+    host_bufs = ACL_FRAG_PENDING;
+  frag_mtu = ctrl_mtu;
+  wr16(&packet[6], host_mtu);
+  wr16(&packet[9], host_bufs);
+}
+
+// Rewrites each handle's count from fragments to host packets; returns the
+// number of host packets left in the event
+static uint32_t __not_in_flash_func(completed_packets)(uint8_t *packet,
+                                                       uint16_t size) {
+  uint8_t n = packet[2];
+  if (size < 3 + 4 * n)
+    return 1; // Malformed: forward untouched
+
+  uint32_t total = 0;
+  for (uint8_t i = 0; i < n; i++) {
+    uint8_t *h = &packet[3 + 2 * i];
+    uint8_t *c = &packet[3 + 2 * n + 2 * i];
+    frag_link_t *link = find_link(rd16(h) & 0x0FFF);
+    uint16_t count = rd16(c);
+    if (!link) {
+      total += count;
+      continue;
+    }
+
+    uint16_t pkts = 0;
+    link->done += count;
+    while (link->tail != link->head &&
+           link->done >= link->frags[link->tail & (ACL_FRAG_PENDING - 1)]) {
+      link->done -= link->frags[link->tail & (ACL_FRAG_PENDING - 1)];
+      link->tail++;
+      pkts++;
+    }
+    if (link->tail == link->head) {
+      // Completions beyond our records: sent before the link was tracked
+      untracked += link->done;
+      pkts += link->done;
+      link->handle = ACL_FRAG_NO_HANDLE;
+    }
+    wr16(c, pkts);
+    total += pkts;
+  }
+  return total;
+}
+
+bool __not_in_flash_func(acl_frag_rx)(uint8_t packet_type, uint8_t *packet,
+                                      uint16_t size) {
+  if (packet_type != HCI_EVENT_PACKET || size < 3)
+    return false;
+  apply_reset();
+
+  switch (packet[0]) {
+  case HCI_EVT_COMMAND_COMPLETE:
+    read_buffer_size(packet, size);
+    return false;
+  case HCI_EVT_NUM_COMPLETED_PACKETS:
+    return frag_mtu && completed_packets(packet, size) == 0;
+  case HCI_EVT_DISCONN_COMPLETE:
+    if (size >= 6 && packet[2] == 0) {
+      frag_link_t *link = find_link(rd16(&packet[3]) & 0x0FFF);
+      if (link)
+        link->handle = ACL_FRAG_NO_HANDLE;
+    }
+    return false;
+  default:
+    return false;
+  }
+}
+
+// --- Core 0: TX path ---
+
+uint16_t __not_in_flash_func(acl_frag_mtu)(void) {
+  apply_reset();
+  return frag_mtu;
+}
+
+void __not_in_flash_func(acl_frag_tx_begin)(const hci_packet_entry_t *entry,
+                                            uint16_t frags) {
+  host_pkts++;
+  host_bytes += entry->size;
+  if (frags > 1) {
+    split++;
+    fragments += frags;
+  }
+  if (!frag_mtu)
+    return;
+
+  uint16_t handle = rd16(entry->data) & 0x0FFF;
+  frag_link_t *link = find_link(handle);
+  if (!link) {
+    link = find_link(ACL_FRAG_NO_HANDLE);
+    if (!link)
+      return; // Completions pass through untranslated
+    link->handle = handle;
+    link->head = link->tail = 0;
+    link->done = 0;
+  }
+  // host_bufs <= ACL_FRAG_PENDING: the host cannot have more in flight
+  if ((uint8_t)(link->head - link->tail) >= ACL_FRAG_PENDING)
+    return;
+  link->frags[link->head & (ACL_FRAG_PENDING - 1)] = frags;
+  link->head++;
+}
+
+// --- Core 1 ---
+
+void __not_in_flash_func(acl_frag_usb_out)(uint16_t len) {
+  usb_xfers++;
+  usb_pkts += (len + USB_BULK_PACKET - 1) / USB_BULK_PACKET;
+}
+
+void acl_frag_get_stats_and_reset(acl_frag_stats_t *out) {
+  // Core 1 counters are monotonic; report deltas
+  static uint32_t last_xfers, last_pkts;
+  uint32_t xfers = usb_xfers, pkts = usb_pkts;
+  // Completions are translated from an IRQ on this core
+  uint32_t flags = save_and_disable_interrupts();
+
+  out->ctrl_mtu = ctrl_mtu;
+  out->ctrl_bufs = ctrl_bufs;
+  out->host_mtu = host_mtu;
+  out->host_bufs = host_bufs;
+  out->usb_xfers = xfers - last_xfers;
+  out->usb_pkts = pkts - last_pkts;
+  out->host_pkts = host_pkts;
+  out->host_bytes = host_bytes;
+  out->split = split;
+  out->fragments = fragments;
+  out->untracked = untracked;
+
+  last_xfers = xfers;
+  last_pkts = pkts;
+  host_pkts = host_bytes = split = fragments = untracked = 0;
+  restore_interrupts(flags);
+}
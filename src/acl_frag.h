@@ -0,0 +1,65 @@
+// acl_frag.h - Host-sized ACL packets fragmented to the controller MTU
+// The controller's Read Buffer Size response is rewritten so the host sends
+// ACL packets of up to ACL_FRAG_HOST_MTU bytes: fewer, larger USB bulk OUT
+// transfers. Core 0 sends each host packet as controller-sized fragments
+// (continuation packet boundary flag after the first) and translates the
+// controller's Number of Completed Packets from fragments back to host
+// packets. The advertised buffer count is scaled so the host's packets in
+// flight never need more controller buffers than exist.
+#ifndef ACL_FRAG_H
+#define ACL_FRAG_H
+
+#include "hci_packet_queue.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Advertise the larger size to the host (0 = pass through, for A/B runs)
+#ifndef DONGLE_ACL_FRAG
+#define DONGLE_ACL_FRAG 1
+#endif
+
+// Largest host ACL payload: one queue entry
+#define ACL_FRAG_HOST_MTU (HCI_PACKET_MAX_SIZE - 4)
+
+typedef struct {
+  uint16_t ctrl_mtu;   // Controller ACL payload size / buffers (0: unknown)
+  uint16_t ctrl_bufs;
+  uint16_t host_mtu;   // As advertised to the host
+  uint16_t host_bufs;
+  uint32_t usb_xfers;  // Host ACL packets reassembled from bulk OUT
+  uint32_t usb_pkts;   // ... and the 64-byte USB packets they took
+  uint32_t host_pkts;  // Host ACL packets sent to the controller
+  uint32_t host_bytes;
+  uint32_t split;      // Host packets sent as more than one fragment
+  uint32_t fragments;  // Controller packets for them
+  uint32_t untracked;  // Completions that could not be translated
+} acl_frag_stats_t;
+
+void acl_frag_init(void);
+
+// Clear MTU and completion state (HCI Reset from host, Core 1). Applied on
+// Core 0.
+void acl_frag_reset(void);
+
+// RX path (Core 0, CYW43 context): rewrites Read Buffer Size and Number of
+// Completed Packets in place. Returns true if the event was consumed (no
+// host packet completed).
+bool acl_frag_rx(uint8_t packet_type, uint8_t *packet, uint16_t size);
+
+// TX path (Core 0, CYW43 lock held): payload bytes per controller packet,
+// or 0 to send host packets unchanged
+uint16_t acl_frag_mtu(void);
+
+// TX path (Core 0, CYW43 lock held): a host ACL packet's first fragment was
+// accepted by the controller; frags is its number of controller packets
+void acl_frag_tx_begin(const hci_packet_entry_t *entry, uint16_t frags);
+
+// Core 1: a host ACL packet of len bytes was reassembled from bulk OUT. The
+// BTH driver reports every 64-byte USB packet, so bt_hci.c counts here, once
+// per host write.
+void acl_frag_usb_out(uint16_t len);
+
+// Windowed stats since the previous call (Core 0)
+void acl_frag_get_stats_and_reset(acl_frag_stats_t *out);
+
+#endif // ACL_FRAG_H
@@ -0,0 +1,201 @@
+// adv_filter.c - LE Advertising Report deduplication and coalescing
+#include "adv_filter.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+#include "hci_packet_queue.h"
+#include "pico.h"
+#include <string.h>
+
+#define HCI_EVENT_PACKET_TYPE 0x04
+#define HCI_EVT_LE_META 0x3E
+#define HCI_SUBEVT_LE_ADV_REPORT 0x02
+
+// Report layout: evt_type(1) addr_type(1) addr(6) data_len(1) data(n) rssi(1)
+#define ADV_REPORT_FIXED_LEN 10
+#define ADV_EVENT_HDR_LEN 4 // event code, param len, subevent, num reports
+#define ADV_EVENT_MAX_PARAMS 255
+#define ADV_COALESCE_MAX_REPORTS 8
+
+// Dedup table: 32 entries, 4-way linear probe
+#define ADV_DEDUP_ENTRIES 32
+#define ADV_DEDUP_PROBE 4
+
+#define ADV_DEDUP_WINDOW_MS_DEFAULT 500
+#define ADV_COALESCE_US_DEFAULT 5000
+
+typedef struct {
+  uint8_t addr[6];
+  uint8_t addr_type;
+  bool valid;
+  uint32_t hash;    // evt_type + payload
+  uint32_t last_us; // Last time this report was forwarded
+} adv_dedup_entry_t;
+
+static adv_dedup_entry_t dedup[ADV_DEDUP_ENTRIES];
+
+// Pending coalesced event (HCI event header included)
+static uint8_t pending[2 + ADV_EVENT_MAX_PARAMS];
+static uint16_t pending_len = 0;
+static uint32_t pending_since_us = 0;
+
+static volatile bool enabled = DONGLE_ADV_FILTER;
+static volatile uint32_t dedup_window_us = ADV_DEDUP_WINDOW_MS_DEFAULT * 1000;
+static volatile uint32_t coalesce_us = ADV_COALESCE_US_DEFAULT;
+
+static volatile adv_filter_stats_t stats = {0};
+
+void adv_filter_init(void) {
+  memset(dedup, 0, sizeof(dedup));
+  pending_len = 0;
+  memset((void *)&stats, 0, sizeof(stats));
+}
+
+// FNV-1a
+static inline uint32_t hash_bytes(uint32_t h, const uint8_t *p, uint16_t n) {
+  while (n--) {
+    h ^= *p++;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+// Returns true if this report was forwarded recently (suppress it)
+static bool __not_in_flash_func(dedup_check)(const uint8_t *report,
+                                             uint8_t data_len, uint32_t now) {
+  const uint8_t *addr = &report[2];
+  uint8_t addr_type = report[1];
+  uint32_t payload = hash_bytes(2166136261u, &report[0], 1);
+  payload = hash_bytes(payload, &report[9], data_len);
+
+  uint32_t slot = hash_bytes(2166136261u, addr, 6) % ADV_DEDUP_ENTRIES;
+  adv_dedup_entry_t *victim = &dedup[slot];
+
+  for (int i = 0; i < ADV_DEDUP_PROBE; i++) {
+    adv_dedup_entry_t *e = &dedup[(slot + i) % ADV_DEDUP_ENTRIES];
+    if (e->valid && e->addr_type == addr_type &&
+        memcmp(e->addr, addr, 6) == 0) {
+      // Don't refresh on suppression: a steady advertiser is still
+      // forwarded once per window so the host sees it (and its RSSI)
+      if (e->hash == payload && now - e->last_us < dedup_window_us)
+        return true;
+      e->hash = payload;
+      e->last_us = now;
+      return false;
+    }
+    if (!e->valid)
+      victim = e;
+    else if (victim->valid && now - e->last_us > now - victim->last_us)
+      victim = e;
+  }
+
+  memcpy(victim->addr, addr, 6);
+  victim->addr_type = addr_type;
+  victim->hash = payload;
+  victim->last_us = now;
+  victim->valid = true;
+  return false;
+}
+
+void __not_in_flash_func(adv_filter_flush)(void) {
+  if (pending_len == 0)
+    return;
+  hci_rx_enqueue(HCI_EVENT_PACKET_TYPE, pending, pending_len);
+  stats.events_out++;
+  pending_len = 0;
+}
+
+bool __not_in_flash_func(adv_filter_flush_due)(void) {
+  return pending_len && time_us_32() - pending_since_us >= coalesce_us;
+}
+
+// Append one report to the pending event, flushing first if it won't fit
+// or its window has already expired
+static void __not_in_flash_func(coalesce_report)(const uint8_t *report,
+                                                 uint16_t report_len,
+                                                 uint32_t now) {
+  if (pending_len &&
+      (pending_len + report_len > sizeof(pending) ||
+       pending[3] >= ADV_COALESCE_MAX_REPORTS ||
+       now - pending_since_us >= coalesce_us))
+    adv_filter_flush();
+
+  if (pending_len == 0) {
+    pending[0] = HCI_EVT_LE_META;
+    pending[1] = 2;
+    pending[2] = HCI_SUBEVT_LE_ADV_REPORT;
+    pending[3] = 0;
+    pending_len = ADV_EVENT_HDR_LEN;
+    pending_since_us = now;
+  }
+
+  memcpy(&pending[pending_len], report, report_len);
+  pending_len += report_len;
+  pending[1] = (uint8_t)(pending_len - 2);
+  pending[3]++;
+}
+
+bool __not_in_flash_func(adv_filter_rx)(uint8_t packet_type,
+                                        const uint8_t *packet, uint16_t size) {
+  if (!enabled || packet_type != HCI_EVENT_PACKET_TYPE ||
+      size < ADV_EVENT_HDR_LEN || packet[0] != HCI_EVT_LE_META ||
+      packet[2] != HCI_SUBEVT_LE_ADV_REPORT) {
+    adv_filter_flush();
+    return false;
+  }
+
+  // Validate the whole event before touching state; pass malformed and
+  // empty events through
+  uint8_t num = packet[3];
+  if (num == 0) {
+    adv_filter_flush();
+    return false;
+  }
+  uint16_t off = ADV_EVENT_HDR_LEN;
+  for (uint8_t i = 0; i < num; i++) {
+    if (off + ADV_REPORT_FIXED_LEN > size ||
+        off + ADV_REPORT_FIXED_LEN + packet[off + 8] > size) {
+      adv_filter_flush();
+      return false;
+    }
+    off += ADV_REPORT_FIXED_LEN + packet[off + 8];
+  }
+
+  uint32_t now = time_us_32();
+  stats.events_in++;
+  stats.reports_in += num;
+
+  off = ADV_EVENT_HDR_LEN;
+  for (uint8_t i = 0; i < num; i++) {
+    uint8_t data_len = packet[off + 8];
+    uint16_t report_len = ADV_REPORT_FIXED_LEN + data_len;
+    if (dedup_check(&packet[off], data_len, now))
+      stats.suppressed++;
+    else
+      coalesce_report(&packet[off], report_len, now);
+    off += report_len;
+  }
+
+  if (coalesce_us == 0)
+    adv_filter_flush();
+  return true;
+}
+
+void adv_filter_set_enabled(bool en) { enabled = en; }
+bool adv_filter_get_enabled(void) { return enabled; }
+
+void adv_filter_set_dedup_window_ms(uint32_t ms) {
+  dedup_window_us = ms * 1000;
+}
+uint32_t adv_filter_get_dedup_window_ms(void) {
+  return dedup_window_us / 1000;
+}
+
+void adv_filter_set_coalesce_us(uint32_t us) { coalesce_us = us; }
+uint32_t adv_filter_get_coalesce_us(void) { return coalesce_us; }
+
+void adv_filter_get_stats_and_reset(adv_filter_stats_t *stats_out) {
+  uint32_t flags = save_and_disable_interrupts();
+  *stats_out = (adv_filter_stats_t)stats;
+  memset((void *)&stats, 0, sizeof(stats));
+  restore_interrupts(flags);
+}
@@ -0,0 +1,47 @@
+// adv_filter.h - LE Advertising Report deduplication and coalescing
+// Optional filter on the RX path (CYW43 -> USB). During scans the controller
+// emits one LE Advertising Report event per received advertisement; each
+// becomes a separate USB interrupt transfer. The filter
+//  - suppresses reports seen with the same address + payload within a window
+//  - merges the remaining reports into one event with multiple entries
+#ifndef ADV_FILTER_H
+#define ADV_FILTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Enabled at boot (runtime switchable)
+#ifndef DONGLE_ADV_FILTER
+#define DONGLE_ADV_FILTER 0
+#endif
+
+typedef struct {
+  uint32_t events_in;   // LE Advertising Report events from the controller
+  uint32_t reports_in;  // Reports contained in them
+  uint32_t suppressed;  // Duplicate reports dropped
+  uint32_t events_out;  // Events forwarded to the RX queue
+} adv_filter_stats_t;
+
+void adv_filter_init(void);
+
+// RX path hook (Core 0, CYW43 context). Returns true if the packet was
+// consumed (suppressed or buffered); otherwise flushes any buffered reports
+// so ordering with the packet about to be forwarded is preserved.
+bool adv_filter_rx(uint8_t packet_type, const uint8_t *packet, uint16_t size);
+
+// Forward buffered reports older than the coalescing window. Call from the
+// Core 0 loop with the CYW43 lock held (cyw43_thread_enter).
+bool adv_filter_flush_due(void);
+void adv_filter_flush(void);
+
+// Runtime configuration
+void adv_filter_set_enabled(bool enabled);
+bool adv_filter_get_enabled(void);
+void adv_filter_set_dedup_window_ms(uint32_t ms);
+uint32_t adv_filter_get_dedup_window_ms(void);
+void adv_filter_set_coalesce_us(uint32_t us); // 0 = forward immediately
+uint32_t adv_filter_get_coalesce_us(void);
+
+void adv_filter_get_stats_and_reset(adv_filter_stats_t *stats_out);
+
+#endif // ADV_FILTER_H
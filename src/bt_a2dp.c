@@ -0,0 +1,264 @@
+// bt_a2dp.c - A2DP media link detection and TX scheduling for BT dongle
+//
+// Ownership: link slots are allocated/freed and AVDTP channels learned on
+// Core 0 (controller events and remote signaling). Core 1 only records the
+// identifier of host AVDTP Connection Requests and routes host packets.
+// Per-route in-flight counters (enq on Core 1, deq on Core 0) let Core 1
+// switch a handle between queues only when the old queue holds none of its
+// packets, so packets of one handle are never reordered.
+#include "bt_a2dp.h"
+#include "btstack.h"
+#include "pico.h"
+#include "stats.h"
+#include "topology.h"
+#include <string.h>
+
+#define A2DP_MAX_LINKS 4
+#define A2DP_NO_HANDLE 0xFFFF
+#define A2DP_MAX_AVDTP_CIDS 2 // [0] = signaling, [1] = media
+
+// HCI
+#define HCI_EVT_CONN_COMPLETE 0x03
+#define HCI_EVT_DISCONN_COMPLETE 0x05
+#define HCI_LINK_TYPE_ACL 0x01
+#define ACL_PB_CONTINUATION 0x01
+
+// L2CAP
+#define L2CAP_HDR_LEN 4
+#define L2CAP_CID_SIGNALING 0x0001
+#define L2CAP_PSM_AVDTP 0x0019
+#define L2CAP_CONN_REQ 0x02
+#define L2CAP_CONN_RSP 0x03
+#define L2CAP_DISCONN_REQ 0x06
+#define L2CAP_DISCONN_RSP 0x07
+#define L2CAP_RESULT_SUCCESS 0x0000
+
+typedef struct {
+  volatile uint16_t handle;
+  // Core 0
+  uint16_t avdtp_cids[A2DP_MAX_AVDTP_CIDS]; // Remote CIDs
+  uint8_t n_avdtp;
+  volatile bool media;
+  volatile uint32_t deq[2];
+  // Core 1
+  volatile uint8_t pending_ident; // Host AVDTP Connection Request (0 = none)
+  bool route_prio;                // Route of the PDU being forwarded
+  volatile uint32_t enq[2];
+} a2dp_link_t;
+
+static a2dp_link_t links[A2DP_MAX_LINKS];
+static volatile bool reset_req = false;
+
+static inline uint16_t rd16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+void bt_a2dp_init(void) {
+  memset(links, 0, sizeof(links));
+  for (int i = 0; i < A2DP_MAX_LINKS; i++)
+    links[i].handle = A2DP_NO_HANDLE;
+  reset_req = false;
+}
+
+void bt_a2dp_reset(void) { reset_req = true; }
+
+static inline a2dp_link_t *__not_in_flash_func(find_link)(uint16_t handle) {
+  for (int i = 0; i < A2DP_MAX_LINKS; i++) {
+    if (links[i].handle == handle)
+      return &links[i];
+  }
+  return NULL;
+}
+
+// --- Core 0: link and channel tracking ---
+
+static void link_open(uint16_t handle) {
+  a2dp_link_t *link = find_link(A2DP_NO_HANDLE);
+  if (!link)
+    return;
+  link->n_avdtp = 0;
+  link->media = false;
+  link->pending_ident = 0;
+  link->route_prio = false;
+  // Start in-flight accounting from whatever Core 1 has counted
+  link->deq[0] = link->enq[0];
+  link->deq[1] = link->enq[1];
+  ROLE_BARRIER();
+  link->handle = handle;
+}
+
+static void avdtp_add(a2dp_link_t *link, uint16_t cid) {
+  if (link->n_avdtp < A2DP_MAX_AVDTP_CIDS)
+    link->avdtp_cids[link->n_avdtp++] = cid;
+  link->media = link->n_avdtp >= A2DP_MAX_AVDTP_CIDS;
+}
+
+static void avdtp_remove(a2dp_link_t *link, uint16_t cid) {
+  for (uint8_t i = 0; i < link->n_avdtp; i++) {
+    if (link->avdtp_cids[i] != cid)
+      continue;
+    for (uint8_t j = i + 1; j < link->n_avdtp; j++)
+      link->avdtp_cids[j - 1] = link->avdtp_cids[j];
+    link->n_avdtp--;
+    break;
+  }
+  link->media = link->n_avdtp >= A2DP_MAX_AVDTP_CIDS;
+}
+
+// Iterate the commands of an L2CAP signaling C-frame (start fragment only)
+typedef void (*sig_cmd_fn)(a2dp_link_t *link, uint8_t code, uint8_t ident,
+                           const uint8_t *data, uint16_t len);
+
+static void __not_in_flash_func(parse_signaling)(a2dp_link_t *link,
+                                                 const uint8_t *pkt,
+                                                 uint16_t size,
+                                                 sig_cmd_fn fn) {
+  if (size < 4 + L2CAP_HDR_LEN || rd16(&pkt[6]) != L2CAP_CID_SIGNALING)
+    return;
+  uint16_t end = 4 + L2CAP_HDR_LEN + rd16(&pkt[4]);
+  if (end > size)
+    end = size;
+  uint16_t off = 4 + L2CAP_HDR_LEN;
+  while (off + 4 <= end) {
+    uint16_t len = rd16(&pkt[off + 2]);
+    if (off + 4 + len > end)
+      break;
+    fn(link, pkt[off], pkt[off + 1], &pkt[off + 4], len);
+    off += 4 + len;
+  }
+}
+
+static void __not_in_flash_func(rx_sig_cmd)(a2dp_link_t *link, uint8_t code,
+                                            uint8_t ident, const uint8_t *data,
+                                            uint16_t len) {
+  switch (code) {
+  case L2CAP_CONN_REQ: // Remote opens: PSM, SCID (remote)
+    if (len >= 4 && rd16(&data[0]) == L2CAP_PSM_AVDTP)
+      avdtp_add(link, rd16(&data[2]));
+    break;
+  case L2CAP_CONN_RSP: // Remote accepts host request: DCID (remote), ...
+    if (len >= 6 && ident != 0 && ident == link->pending_ident &&
+        rd16(&data[4]) == L2CAP_RESULT_SUCCESS)
+      avdtp_add(link, rd16(&data[0]));
+    break;
+  case L2CAP_DISCONN_REQ: // Remote closes: DCID (host), SCID (remote)
+    if (len >= 4)
+      avdtp_remove(link, rd16(&data[2]));
+    break;
+  case L2CAP_DISCONN_RSP: // Remote confirms host close: DCID (remote)
+    if (len >= 4)
+      avdtp_remove(link, rd16(&data[0]));
+    break;
+  default:
+    break;
+  }
+}
+
+void __not_in_flash_func(bt_a2dp_rx)(uint8_t packet_type,
+                                     const uint8_t *packet, uint16_t size) {
+  if (reset_req) {
+    reset_req = false;
+    for (int i = 0; i < A2DP_MAX_LINKS; i++)
+      links[i].handle = A2DP_NO_HANDLE;
+  }
+
+  if (packet_type == HCI_EVENT_PACKET) {
+    if (packet[0] == HCI_EVT_CONN_COMPLETE && size >= 13 && packet[2] == 0 &&
+        packet[11] == HCI_LINK_TYPE_ACL) {
+      link_open(rd16(&packet[3]) & 0x0FFF);
+    } else if (packet[0] == HCI_EVT_DISCONN_COMPLETE && size >= 6 &&
+               packet[2] == 0) {
+      a2dp_link_t *link = find_link(rd16(&packet[3]) & 0x0FFF);
+      if (link)
+        link->handle = A2DP_NO_HANDLE;
+    }
+    return;
+  }
+
+  if (packet_type != HCI_ACL_DATA_PACKET || size < 4)
+    return;
+  if (((packet[1] >> 4) & 0x3) == ACL_PB_CONTINUATION)
+    return;
+  a2dp_link_t *link = find_link(rd16(packet) & 0x0FFF);
+  if (link)
+    parse_signaling(link, packet, size, rx_sig_cmd);
+}
+
+// --- Core 1: host packet routing ---
+
+static void __not_in_flash_func(tx_sig_cmd)(a2dp_link_t *link, uint8_t code,
+                                            uint8_t ident, const uint8_t *data,
+                                            uint16_t len) {
+  if (code != L2CAP_CONN_REQ || len < 4)
+    return;
+  if (rd16(&data[0]) == L2CAP_PSM_AVDTP)
+    link->pending_ident = ident;
+  else if (ident == link->pending_ident)
+    link->pending_ident = 0;
+}
+
+bool __not_in_flash_func(bt_a2dp_tx_enqueue_acl)(const uint8_t *packet,
+                                                 uint16_t size) {
+  a2dp_link_t *link = size >= 4 ? find_link(rd16(packet) & 0x0FFF) : NULL;
+  if (!link)
+    return hci_tx_enqueue(HCI_ACL_DATA_PACKET, packet, size);
+
+  // Routes change only at PDU start, once the old route has drained
+  if (((packet[1] >> 4) & 0x3) != ACL_PB_CONTINUATION) {
+    parse_signaling(link, packet, size, tx_sig_cmd);
+    bool want = DONGLE_A2DP_SCHED && link->media;
+    uint8_t cur = link->route_prio;
+    if (want != link->route_prio && link->enq[cur] == link->deq[cur])
+      link->route_prio = want;
+  }
+
+  bool prio = link->route_prio;
+  bool ok = prio ? hci_tx_prio_enqueue(HCI_ACL_DATA_PACKET, packet, size)
+                 : hci_tx_enqueue(HCI_ACL_DATA_PACKET, packet, size);
+  if (ok)
+    link->enq[prio]++;
+  return ok;
+}
+
+// --- Core 0: scheduling ---
+
+hci_packet_entry_t *__not_in_flash_func(bt_a2dp_tx_next)(bool *prio) {
+  hci_packet_entry_t *p = hci_tx_prio_peek();
+  hci_packet_entry_t *n = hci_tx_peek();
+  if (!p || !n) {
+    *prio = (p != NULL);
+    return p ? p : n;
+  }
+
+  // Earliest deadline first; commands in the normal queue are due at once
+  uint32_t dp = p->enq_us + A2DP_MEDIA_DEADLINE_US;
+  uint32_t dn = n->enq_us;
+  if (n->packet_type == HCI_ACL_DATA_PACKET)
+    dn += A2DP_BULK_DEADLINE_US;
+  *prio = (int32_t)(dp - dn) <= 0;
+  return *prio ? p : n;
+}
+
+void __not_in_flash_func(bt_a2dp_tx_free)(hci_packet_entry_t *entry,
+                                          bool prio) {
+  if (entry->packet_type == HCI_ACL_DATA_PACKET && entry->size >= 4) {
+    a2dp_link_t *link = find_link(rd16(entry->data) & 0x0FFF);
+    if (link) {
+      link->deq[prio]++;
+      if (link->media)
+        stats_record_media_tx_send();
+    }
+  }
+
+  if (prio)
+    hci_tx_prio_free();
+  else
+    hci_tx_free();
+}
+
+uint8_t bt_a2dp_media_links(void) {
+  uint8_t n = 0;
+  for (int i = 0; i < A2DP_MAX_LINKS; i++) {
+    if (links[i].handle != A2DP_NO_HANDLE && links[i].media)
+      n++;
+  }
+  return n;
+}
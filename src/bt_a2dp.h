@@ -0,0 +1,42 @@
+// bt_a2dp.h - A2DP media link detection and TX scheduling for BT dongle
+// Watches L2CAP signaling on both ACL paths to learn which connection
+// handle carries an AVDTP media channel (the second AVDTP channel opened on
+// a link). Host ACL packets for that handle go to the priority TX queue;
+// Core 0 then serves both TX queues earliest-deadline-first, so media
+// packets are not starved by bulk (file transfer, GATT) traffic on other
+// handles. Packet order within a handle is always preserved.
+#ifndef BT_A2DP_H
+#define BT_A2DP_H
+
+#include "hci_packet_queue.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Route media links to the priority queue (0 = detect only, for A/B runs)
+#ifndef DONGLE_A2DP_SCHED
+#define DONGLE_A2DP_SCHED 1
+#endif
+
+// Scheduling deadlines relative to enqueue time
+#define A2DP_MEDIA_DEADLINE_US 5000
+#define A2DP_BULK_DEADLINE_US 40000
+
+void bt_a2dp_init(void);
+
+// Clear link state (HCI Reset from host, Core 1). Applied on Core 0.
+void bt_a2dp_reset(void);
+
+// RX path (Core 0): observe controller events and ACL signaling
+void bt_a2dp_rx(uint8_t packet_type, const uint8_t *packet, uint16_t size);
+
+// TX path (Core 1): enqueue a complete host ACL packet on the right queue
+bool bt_a2dp_tx_enqueue_acl(const uint8_t *packet, uint16_t size);
+
+// Core 0: pick the next TX entry (EDF across both queues) and release it
+hci_packet_entry_t *bt_a2dp_tx_next(bool *prio);
+void bt_a2dp_tx_free(hci_packet_entry_t *entry, bool prio);
+
+// Number of links currently carrying an A2DP media channel
+uint8_t bt_a2dp_media_links(void);
+
+#endif // BT_A2DP_H
@@ -1,9 +1,15 @@
 // bt_hci.c - HCI packet handling for Pico W Bluetooth Dongle
 #include "bt_hci.h"
+#include "acl_frag.h"
+#include "adv_filter.h"
+#include "bt_a2dp.h"
 #include "bt_sco.h"
 #include "btstack.h"
 #include "hci_packet_queue.h"
+#include "hci_stats.h"
 #include "pico.h"
+#include "placement.h"
+#include "vendor_cmd.h"
 #include <string.h>
 
 // --- Debug Logging ---
@@ -19,12 +25,18 @@
 
 // --- ACL Reassembly ---
 static uint8_t acl_reassembly_buf[2048];
-static uint16_t acl_reassembly_len = 0;
+static uint16_t USB_CORE_DATA("acl_reassembly") acl_reassembly_len = 0;
 static uint32_t reassembly_errors = 0;
 
 // --- Public Functions ---
 
-void bt_hci_reset_state(void) { acl_reassembly_len = 0; }
+void bt_hci_reset_state(void) {
+  acl_reassembly_len = 0;
+  bt_a2dp_reset();
+  hci_stats_reset();
+  acl_frag_reset();
+  bt_sco_set_voice_setting(BT_SCO_VOICE_SETTING_DEFAULT);
+}
 
 uint32_t bt_hci_get_reassembly_errors(void) { return reassembly_errors; }
 
@@ -45,12 +57,26 @@ void __not_in_flash_func(hci_packet_handler)(uint8_t packet_type,
     return;
   }
 
+  // Controller ACL size and completions as the host sees them
+  if (acl_frag_rx(packet_type, packet, size))
+    return;
+
+  // Track A2DP media links (connection events, L2CAP signaling)
+  bt_a2dp_rx(packet_type, packet, size);
+
+  // Optional LE Advertising Report dedup/coalescing
+  if (adv_filter_rx(packet_type, packet, size))
+    return;
+
   // Forward to RX queue for Core 1 to send via USB
-  hci_rx_enqueue(packet_type, packet, size);
+  bool queued = hci_rx_enqueue(packet_type, packet, size);
+
+  // Command latency, per-connection RX accounting
+  hci_stats_rx(packet_type, packet, size, queued);
 }
 
 // DOWNSTREAM: Host PC -> Pico -> CYW43 (HCI Commands)
-void tud_bt_hci_cmd_cb(void *hci_cmd, size_t cmd_len) {
+void __not_in_flash_func(tud_bt_hci_cmd_cb)(void *hci_cmd, size_t cmd_len) {
   if (cmd_len < 2)
     return;
 
@@ -58,16 +84,28 @@ void tud_bt_hci_cmd_cb(void *hci_cmd, size_t cmd_len) {
   uint16_t opcode = cmd[0] | (cmd[1] << 8);
   DBG_PRINTF("[CMD] Opcode=0x%04X Len=%zu\n", opcode, cmd_len);
 
+  // Dongle vendor commands are answered locally, never forwarded
+  if (vendor_cmd_is_local(opcode)) {
+    vendor_cmd_submit(cmd, cmd_len);
+    return;
+  }
+
   // Handle HCI Reset - reset local state
   if (opcode == 0x0C03) {
     bt_hci_reset_state();
   }
 
-  hci_tx_enqueue(HCI_COMMAND_DATA_PACKET, cmd, cmd_len);
+  // HCI_Write_Voice_Setting: the air coding decides whether SCO is transcoded
+  if (opcode == 0x0C26 && cmd_len >= 5)
+    bt_sco_set_voice_setting(cmd[3] | (cmd[4] << 8));
+
+  if (hci_tx_enqueue(HCI_COMMAND_DATA_PACKET, cmd, cmd_len))
+    hci_stats_cmd_issued(opcode);
 }
 
 // DOWNSTREAM: Host PC -> Pico -> CYW43 (ACL Data)
-void tud_bt_acl_data_received_cb(void *acl_data, uint16_t data_len) {
+void __not_in_flash_func(tud_bt_acl_data_received_cb)(void *acl_data,
+                                                      uint16_t data_len) {
   // Overflow protection
   if (acl_reassembly_len + data_len > sizeof(acl_reassembly_buf)) {
     DBG_PRINTF("[ACL] Overflow! Resetting.\n");
@@ -89,7 +127,9 @@ void tud_bt_acl_data_received_cb(void *acl_data, uint16_t data_len) {
 
     if (acl_reassembly_len >= packet_len) {
       DBG_PRINTF("[ACL] Fwd to CYW43 (Len %d)\n", packet_len);
-      hci_tx_enqueue(HCI_ACL_DATA_PACKET, acl_reassembly_buf, packet_len);
+      acl_frag_usb_out(packet_len);
+      bool queued = bt_a2dp_tx_enqueue_acl(acl_reassembly_buf, packet_len);
+      hci_stats_acl_tx(acl_reassembly_buf, packet_len, queued);
 
       // Shift remaining data
       uint16_t remaining = acl_reassembly_len - packet_len;
@@ -104,4 +144,6 @@ void tud_bt_acl_data_received_cb(void *acl_data, uint16_t data_len) {
 }
 
 // Called when HCI event sent successfully
-void tud_bt_event_sent_cb(uint16_t sent_bytes) { (void)sent_bytes; }
+void __not_in_flash_func(tud_bt_event_sent_cb)(uint16_t sent_bytes) {
+  (void)sent_bytes;
+}
@@ -1,16 +1,45 @@
 // bt_sco.c - SCO (Voice) packet handling for BT dongle
 // SCO packets are used for voice calls (HFP/HSP)
-// Uses raw TinyUSB endpoint APIs for isochronous transfers
+// Uses raw TinyUSB endpoint APIs for isochronous transfers. TinyUSB's BTH
+// class driver opens the voice interface but ignores SET_INTERFACE and the
+// ISO endpoints, so an application class driver (end of file) claims the BTH
+// interfaces in front of it: HCI traffic is passed to the stock btd_*
+// functions, the voice alternate setting and ISO completions come here.
+//
+// Rate matching: the USB frame clock and the controller's SCO slot clock
+// drift apart over a long call. SCO packets from the CYW43 (Core 0) land in
+// a small ring; Core 1 starts one ISO IN transfer per SOF whenever the
+// endpoint is idle, so the USB side drains at exactly the host's rate. The
+// ring level absorbs jitter and drift: above the high watermark the oldest
+// packet is dropped (bounds latency), on underrun the last packet is
+// repeated (keeps the ISO stream continuous). Host SCO packets (ISO OUT,
+// Core 1) are reassembled from the ISO packets by their header length, go
+// through a second ring and are sent to the CYW43 from Core 0. The OUT side
+// is not rate matched: the controller takes packets as it needs them, the
+// ring absorbs jitter, and a host running fast shows up as OUT drops and a
+// positive host rate in the stats.
 
 #include "bt_sco.h"
 #include "btstack.h"
 #include "hci_packet_queue.h"
 #include "pico/btstack_hci_transport_cyw43.h"
+#include "pico/cyw43_arch.h"
+#include "sco_codec.h"
+#include "topology.h"
+#include "trace.h"
+#include "tusb.h"
 #include "usb_descriptors.h"
 #include <device/usbd_pvt.h>
 #include <stdio.h>
 #include <string.h>
 
+// The application driver below wraps btd_deinit (the class driver .deinit
+// hook) and the ISO endpoint alloc/activate API, both TinyUSB 0.17+ (Pico SDK
+// 2.1+). Older stacks would build the voice interface without SET_INTERFACE.
+#if TUSB_VERSION_MAJOR == 0 && TUSB_VERSION_MINOR < 17
+#error "SCO voice support needs TinyUSB 0.17 or newer (Pico SDK 2.1 or newer)"
+#endif
+
 // SCO packet structure: 3-byte header + payload
 // Header: Connection Handle (12 bits) + Packet Status Flag (2 bits) + Data
 // Length (8 bits)
@@ -18,45 +47,191 @@
 #define SCO_MAX_PAYLOAD 60
 #define SCO_MAX_PACKET (SCO_HEADER_SIZE + SCO_MAX_PAYLOAD)
 
+// IN fill levels, in packets (ring depth SCO_RING_SIZE in bt_sco.h). At 3 ms
+// per CVSD packet the high watermark bounds buffering to ~12 ms (30 ms for
+// mSBC).
+#define SCO_LEVEL_TARGET 2
+#define SCO_LEVEL_HIGH 4
+
+// Runtime IN fill levels, packed (target | high << 8) so Core 1 always reads
+// a consistent pair
+static volatile uint16_t sco_levels = SCO_LEVEL_TARGET | (SCO_LEVEL_HIGH << 8);
+
+// Nominal controller SCO payload rate per ISO alternate setting (bytes/ms),
+// as defined in usb_descriptors.c: alt 1 CVSD 8 kHz 8-bit, alt 2 16-bit,
+// alt 3 mSBC (60 bytes per 7.5 ms, also the transcoded stream's air rate)
+static const uint8_t sco_bytes_per_ms[CFG_TUD_BTH_ISO_ALT_COUNT] = {
+    0, 8, 16, 8};
+
+#if DONGLE_SCO_TRANSCODE
+// PCM over ISO: one 243-byte SCO packet (120 samples, 16 kHz 16-bit) per
+// 7.5 ms, streamed across USB frames (32.4 bytes/frame within alt 3's 33)
+#define SCO_TRANSCODE_ALT 3
+#define SCO_PCM_PAYLOAD (SCO_CODEC_FRAME_SAMPLES * 2)
+#define SCO_PCM_PACKET (SCO_HEADER_SIZE + SCO_PCM_PAYLOAD)
+#define SCO_PCM_FRAME_MAX 33
+#endif
+
+typedef struct {
+  uint8_t len;
+  uint8_t _pre_buffer[4]; // Space for CYW43 transport header
+  uint8_t data[SCO_MAX_PACKET];
+} sco_slot_t;
+
+// SPSC ring; head/tail free-running, index = count & (SCO_RING_SIZE - 1)
+typedef struct {
+  sco_slot_t slot[SCO_RING_SIZE];
+  volatile uint8_t head; // Producer
+  volatile uint8_t tail; // Consumer
+} sco_ring_t;
+
 // HCI transport
 static const hci_transport_t *sco_transport = NULL;
 
-// TX buffer (CYW43 -> USB)
+// IN ring (CYW43 -> USB): Core 0 produces, Core 1 consumes
+static sco_ring_t in_ring;
+// OUT ring (USB -> CYW43): Core 1 produces, Core 0 consumes
+static sco_ring_t out_ring;
+
+// TX buffer (CYW43 -> USB), owned by the ISO IN endpoint while busy
 static uint8_t sco_tx_buf[SCO_MAX_PACKET];
 static volatile bool sco_tx_pending = false;
 static uint16_t sco_tx_len = 0;
+static bool sco_streaming = false;
+static volatile bool sco_in_flush_req = false;
 
-// RX buffer (USB -> CYW43)
+// RX buffer (USB -> CYW43), one ISO OUT packet of the current alt setting
 static uint8_t sco_rx_buf[SCO_MAX_PACKET];
-static volatile bool sco_rx_ready = false;
+static uint16_t sco_rx_size = 0;
 
-// Statistics
-static volatile uint32_t sco_rx_count = 0;
-static volatile uint32_t sco_tx_count = 0;
-static volatile uint32_t sco_tx_errors = 0;
+#if DONGLE_SCO_TRANSCODE
+// Core 1: decoded packet being streamed to USB
+static uint8_t pcm_in_pkt[SCO_PCM_PACKET];
+static uint16_t pcm_in_off = SCO_PCM_PACKET;
+static bool pcm_in_valid = false;
+static uint32_t pcm_in_acc = 0;
+#define SCO_OUT_PACKET_MAX SCO_PCM_PACKET
+#else
+#define SCO_OUT_PACKET_MAX SCO_MAX_PACKET
+#endif
+
+// Core 1: host packet being collected from the ISO OUT stream
+static uint8_t out_pkt[SCO_OUT_PACKET_MAX];
+static uint16_t out_len = 0;
+
+// Statistics (monotonic)
+// Core 0
+static volatile uint32_t sco_rx_count = 0;    // CYW43 packets
+static volatile uint32_t sco_rx_bytes = 0;    // CYW43 payload bytes (active)
+static volatile uint32_t sco_in_overflow = 0; // IN ring full
+static volatile uint32_t sco_out_sent = 0;    // Host packets sent to CYW43
+// Core 1
+static volatile uint32_t sco_tx_count = 0;     // ISO IN transfers
+static volatile uint32_t sco_tx_errors = 0;    // ISO IN transfer failures
+static volatile uint32_t sco_dropped = 0;      // Dropped above high watermark
+static volatile uint32_t sco_inserted = 0;     // Repeated on underrun
+static volatile uint32_t sco_out_overflow = 0; // OUT ring full
+static volatile uint32_t sco_out_bytes = 0;    // Host payload bytes queued
+static volatile uint32_t sco_sof_frames = 0;   // SOFs while active
+
+// Counter values when the current alt setting was selected (Core 1). Rates
+// are measured from here: over one 10 s window a single packet of phase
+// jitter is several hundred ppm, real clock drift only tens.
+static volatile uint32_t alt_epoch = 0; // Odd while the base is being written
+static uint32_t alt_base_frames = 0;
+static uint32_t alt_base_rx_bytes = 0;
+static uint32_t alt_base_out_bytes = 0;
+
+// IN ring level seen at each SOF (Core 1; reset on request by the reporter)
+static uint8_t level_min = 0xFF;
+static uint8_t level_max = 0;
+static uint32_t level_sum = 0;
+static uint32_t level_samples = 0;
+static uint8_t out_level_max = 0; // OUT ring level after each push
+static volatile bool level_reset_req = false;
 
 // Current alternate setting (0 = inactive)
 static volatile uint8_t current_alt_setting = 0;
 
+// Host voice setting (USB side)
+#define VOICE_AIR_CODING_MASK 0x0003
+#define VOICE_AIR_CODING_TRANSPARENT 0x0003
+static volatile uint16_t voice_setting = BT_SCO_VOICE_SETTING_DEFAULT;
+
+static inline uint8_t ring_level(const sco_ring_t *r) {
+  return (uint8_t)(r->head - r->tail);
+}
+
+static bool __not_in_flash_func(ring_push)(sco_ring_t *r, const uint8_t *pkt,
+                                           uint16_t len) {
+  if (ring_level(r) >= SCO_RING_SIZE)
+    return false;
+  sco_slot_t *s = &r->slot[r->head & (SCO_RING_SIZE - 1)];
+  if (len > SCO_MAX_PACKET)
+    len = SCO_MAX_PACKET;
+  memcpy(s->data, pkt, len);
+  s->len = (uint8_t)len;
+  ROLE_BARRIER();
+  r->head++;
+  return true;
+}
+
+static sco_slot_t *__not_in_flash_func(ring_peek)(sco_ring_t *r) {
+  if (ring_level(r) == 0)
+    return NULL;
+  ROLE_BARRIER();
+  return &r->slot[r->tail & (SCO_RING_SIZE - 1)];
+}
+
+static inline void ring_pop(sco_ring_t *r) {
+  ROLE_BARRIER();
+  r->tail++;
+}
+
 void bt_sco_init(void) {
+  memset(&in_ring, 0, sizeof(in_ring));
+  memset(&out_ring, 0, sizeof(out_ring));
   sco_rx_count = 0;
   sco_tx_count = 0;
   sco_tx_errors = 0;
   sco_tx_pending = false;
-  sco_rx_ready = false;
+  sco_tx_len = 0;
+  sco_streaming = false;
+  sco_rx_size = 0;
   current_alt_setting = 0;
   sco_transport = hci_transport_cyw43_instance();
   printf("SCO Voice support initialized\n");
 }
 
-// Set alternate setting (called from USB stack when host changes alt)
+// Set alternate setting (voice interface SET_INTERFACE, after the ISO
+// endpoints were reopened with the new packet sizes)
 void bt_sco_set_alt_setting(uint8_t alt) {
   current_alt_setting = alt;
+  alt_epoch++;
+  ROLE_BARRIER();
+  alt_base_frames = sco_sof_frames;
+  alt_base_rx_bytes = sco_rx_bytes;
+  alt_base_out_bytes = sco_out_bytes;
+  ROLE_BARRIER();
+  alt_epoch++;
+  // Start every stream from an empty ring and a fresh prefill
+  sco_in_flush_req = true;
+  sco_tx_pending = false;
+  tud_sof_cb_enable(alt > 0);
+#if DONGLE_SCO_TRANSCODE
+  if (alt == SCO_TRANSCODE_ALT) {
+    sco_codec_start();
+    pcm_in_off = SCO_PCM_PACKET;
+    pcm_in_valid = false;
+    pcm_in_acc = 0;
+  }
+#endif
+  out_len = 0;
   if (alt > 0) {
     printf("[SCO] Alt setting %d activated\n", alt);
     // Queue first RX transfer
-    if (!usbd_edpt_busy(0, EPNUM_BT_ISO_OUT)) {
-      usbd_edpt_xfer(0, EPNUM_BT_ISO_OUT, sco_rx_buf, SCO_MAX_PACKET);
+    if (sco_rx_size && !usbd_edpt_busy(0, EPNUM_BT_ISO_OUT)) {
+      usbd_edpt_xfer(0, EPNUM_BT_ISO_OUT, sco_rx_buf, sco_rx_size);
     }
   } else {
     printf("[SCO] Alt setting 0 (inactive)\n");
@@ -65,58 +240,498 @@ void bt_sco_set_alt_setting(uint8_t alt) {
 
 uint8_t bt_sco_get_alt_setting(void) { return current_alt_setting; }
 
+void bt_sco_set_voice_setting(uint16_t setting) { voice_setting = setting; }
+
 // Handle incoming SCO packet from CYW43 chip (RX: CYW43 -> USB)
-void bt_sco_rx_packet(const uint8_t *packet, uint16_t size) {
+void __not_in_flash_func(bt_sco_rx_packet)(const uint8_t *packet,
+                                           uint16_t size) {
   sco_rx_count++;
+  TRACE(TRACE_EV_SCO_FRAME, size);
 
   // Only forward if voice interface is active
-  if (current_alt_setting == 0)
+  if (current_alt_setting == 0 || size < SCO_HEADER_SIZE)
     return;
 
-  // Check if USB endpoint is ready
-  if (usbd_edpt_busy(0, EPNUM_BT_ISO_IN)) {
-    // Previous transfer not complete, skip
+  sco_rx_bytes += size - SCO_HEADER_SIZE;
+  if (!ring_push(&in_ring, packet, size))
+    sco_in_overflow++;
+}
+
+// Only a transparent SCO link carries mSBC; with CVSD air coding the
+// controller converts the host's linear PCM and alt 3 passes through
+static inline bool transcoding(void) {
+#if DONGLE_SCO_TRANSCODE
+  return current_alt_setting == SCO_TRANSCODE_ALT &&
+         (voice_setting & VOICE_AIR_CODING_MASK) ==
+             VOICE_AIR_CODING_TRANSPARENT;
+#else
+  return false;
+#endif
+}
+
+#if DONGLE_SCO_TRANSCODE
+// Decode the next mSBC packet from the IN ring into pcm_in_pkt
+static bool __not_in_flash_func(pcm_in_next)(void) {
+  int16_t pcm[SCO_CODEC_FRAME_SAMPLES];
+  sco_slot_t *s;
+  while ((s = ring_peek(&in_ring)) != NULL) {
+    bool ok = s->len > SCO_HEADER_SIZE &&
+              sco_codec_decode(&s->data[SCO_HEADER_SIZE],
+                               s->len - SCO_HEADER_SIZE,
+                               (s->data[1] >> 4) & 0x3, pcm);
+    if (ok) {
+      pcm_in_pkt[0] = s->data[0];
+      pcm_in_pkt[1] = s->data[1] & 0x0F; // Handle only; status consumed
+      pcm_in_pkt[2] = SCO_PCM_PAYLOAD;
+      memcpy(&pcm_in_pkt[SCO_HEADER_SIZE], pcm, SCO_PCM_PAYLOAD);
+    }
+    ring_pop(&in_ring);
+    if (ok) {
+      pcm_in_valid = true;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Stream decoded PCM packets at 243 bytes per 7.5 ms (32 or 33 per frame)
+static void __not_in_flash_func(sco_in_stream_pcm)(uint8_t level) {
+  if (usbd_edpt_busy(0, EPNUM_BT_ISO_IN))
     return;
+
+  // 243 bytes / 7.5 ms = 486 / 15 bytes per frame
+  pcm_in_acc += SCO_PCM_PACKET * 2;
+  uint16_t due = pcm_in_acc / 15;
+  pcm_in_acc %= 15;
+
+  uint16_t n = 0;
+  while (n < due) {
+    if (pcm_in_off >= SCO_PCM_PACKET) {
+      if (!pcm_in_next()) {
+        if (!pcm_in_valid)
+          break;
+        sco_inserted++; // Repeat the last decoded packet
+      }
+      pcm_in_off = 0;
+      TRACE(TRACE_EV_SCO_LEVEL, level);
+    }
+    uint16_t chunk = SCO_PCM_PACKET - pcm_in_off;
+    if (chunk > due - n)
+      chunk = due - n;
+    memcpy(&sco_tx_buf[n], &pcm_in_pkt[pcm_in_off], chunk);
+    pcm_in_off += chunk;
+    n += chunk;
   }
+  if (n == 0)
+    return;
 
-  // Copy to TX buffer and send
-  if (size > SCO_MAX_PACKET)
-    size = SCO_MAX_PACKET;
-  memcpy(sco_tx_buf, packet, size);
-  sco_tx_len = size;
+  sco_tx_len = n;
   sco_tx_pending = true;
+  if (usbd_edpt_xfer(0, EPNUM_BT_ISO_IN, sco_tx_buf, n)) {
+    sco_tx_count++;
+  } else {
+    sco_tx_pending = false;
+    sco_tx_errors++;
+  }
+}
+#endif // DONGLE_SCO_TRANSCODE
+
+// Core 1: a host packet is complete; encode it when transcoding, then queue
+// it for the CYW43
+static void __not_in_flash_func(sco_out_packet)(void) {
+  const uint8_t *pkt = out_pkt;
+  uint16_t len = out_len;
+#if DONGLE_SCO_TRANSCODE
+  uint8_t msbc[SCO_MAX_PACKET];
+  if (transcoding()) {
+    int16_t pcm[SCO_CODEC_FRAME_SAMPLES];
+    memcpy(pcm, &out_pkt[SCO_HEADER_SIZE], SCO_PCM_PAYLOAD);
+    msbc[0] = out_pkt[0];
+    msbc[1] = out_pkt[1];
+    msbc[2] = SCO_MSBC_FRAME_LEN;
+    sco_codec_encode(pcm, &msbc[SCO_HEADER_SIZE]);
+    pkt = msbc;
+    len = SCO_HEADER_SIZE + SCO_MSBC_FRAME_LEN;
+  }
+#endif
+  if (!ring_push(&out_ring, pkt, len)) {
+    sco_out_overflow++;
+    return;
+  }
+  sco_out_bytes += len - SCO_HEADER_SIZE;
+  uint8_t level = ring_level(&out_ring);
+  if (level > out_level_max)
+    out_level_max = level;
+}
+
+// Core 1: collect host SCO packets from the ISO OUT stream. A packet spans
+// several ISO packets; its header gives the length.
+static void __not_in_flash_func(sco_out_collect)(const uint8_t *buf,
+                                                 uint16_t len) {
+  while (len > 0) {
+    uint16_t want = out_len < SCO_HEADER_SIZE ? SCO_HEADER_SIZE
+                                              : SCO_HEADER_SIZE + out_pkt[2];
+    uint16_t chunk = want - out_len;
+    if (chunk > len)
+      chunk = len;
+    memcpy(&out_pkt[out_len], buf, chunk);
+    out_len += chunk;
+    buf += chunk;
+    len -= chunk;
+
+    if (out_len == SCO_HEADER_SIZE) {
+      uint8_t payload = out_pkt[2];
+      bool valid = payload > 0 && payload <= SCO_MAX_PAYLOAD;
+#if DONGLE_SCO_TRANSCODE
+      if (transcoding())
+        valid = payload == SCO_PCM_PAYLOAD;
+#endif
+      if (!valid) {
+        // Not a packet header: resynchronize one byte later
+        memmove(out_pkt, &out_pkt[1], SCO_HEADER_SIZE - 1);
+        out_len--;
+        continue;
+      }
+    }
+    if (out_len < SCO_HEADER_SIZE + out_pkt[2])
+      continue;
+
+    sco_out_packet();
+    out_len = 0;
+  }
+}
+
+// Core 1, once per USB frame: pace ISO IN from the IN ring
+static void __not_in_flash_func(sco_in_pace)(void) {
+  if (sco_in_flush_req) {
+    sco_in_flush_req = false;
+    while (ring_peek(&in_ring))
+      ring_pop(&in_ring);
+    sco_streaming = false;
+  }
+
+  uint16_t levels = sco_levels;
+  uint8_t level_target = levels & 0xFF;
+  uint8_t level_high = levels >> 8;
+
+  uint8_t level = ring_level(&in_ring);
+  if (level_reset_req) {
+    level_reset_req = false;
+    level_min = 0xFF;
+    level_max = 0;
+    level_sum = 0;
+    level_samples = 0;
+    out_level_max = 0;
+  }
+  if (level < level_min)
+    level_min = level;
+  if (level > level_max)
+    level_max = level;
+  level_sum += level;
+  level_samples++;
+
+  // Controller clock ahead of USB: drop the oldest to bound latency
+  while (level > level_high) {
+    ring_pop(&in_ring);
+    sco_dropped++;
+    level--;
+  }
+
+  // Prefill to the target level before (re)starting the stream
+  if (!sco_streaming) {
+    if (level < level_target)
+      return;
+    sco_streaming = true;
+  }
+
+#if DONGLE_SCO_TRANSCODE
+  if (transcoding()) {
+    sco_in_stream_pcm(level);
+    return;
+  }
+#endif
+
+  // The endpoint stays busy for len / wMaxPacketSize frames, which paces
+  // the stream at the host's rate
+  if (usbd_edpt_busy(0, EPNUM_BT_ISO_IN))
+    return;
 
-  if (usbd_edpt_xfer(0, EPNUM_BT_ISO_IN, sco_tx_buf, size)) {
+  sco_slot_t *s = ring_peek(&in_ring);
+  if (s) {
+    memcpy(sco_tx_buf, s->data, s->len);
+    sco_tx_len = s->len;
+    ring_pop(&in_ring);
+  } else if (sco_tx_len > 0) {
+    // Controller clock behind USB: repeat the last packet
+    sco_inserted++;
+  } else {
+    return;
+  }
+
+  TRACE(TRACE_EV_SCO_LEVEL, level);
+  sco_tx_pending = true;
+  if (usbd_edpt_xfer(0, EPNUM_BT_ISO_IN, sco_tx_buf, sco_tx_len)) {
     sco_tx_count++;
   } else {
+    sco_tx_pending = false;
     sco_tx_errors++;
   }
+}
 
-  // Log occasionally
-  if ((sco_rx_count % 500) == 1) {
-    printf("[SCO] TX=%lu RX=%lu Err=%lu\n", (unsigned long)sco_tx_count,
-           (unsigned long)sco_rx_count, (unsigned long)sco_tx_errors);
+// TinyUSB SOF callback (Core 1, enabled while an alt setting is active)
+void __not_in_flash_func(tud_sof_cb)(uint32_t frame_count) {
+  (void)frame_count;
+  if (current_alt_setting == 0)
+    return;
+  sco_sof_frames++;
+
+  // Keep an OUT transfer armed every frame
+  if (sco_rx_size && !usbd_edpt_busy(0, EPNUM_BT_ISO_OUT)) {
+    usbd_edpt_xfer(0, EPNUM_BT_ISO_OUT, sco_rx_buf, sco_rx_size);
   }
+  sco_in_pace();
 }
 
 // Called from USB stack when ISO IN transfer completes
-void bt_sco_tx_complete(void) { sco_tx_pending = false; }
+void __not_in_flash_func(bt_sco_tx_complete)(void) {
+  sco_tx_pending = false;
+}
 
 // Called from USB stack when ISO OUT transfer completes
-void bt_sco_rx_complete(uint8_t *buf, uint16_t len) {
-  if (len > 0 && current_alt_setting > 0 && sco_transport) {
-    // Forward to CYW43
-    sco_transport->send_packet(0x03, buf, len); // HCI_SCO_DATA_PACKET
-  }
+void __not_in_flash_func(bt_sco_rx_complete)(uint8_t *buf, uint16_t len) {
+  // Forwarded to CYW43 by Core 0 (bt_sco_task)
+  if (len > 0 && current_alt_setting > 0)
+    sco_out_collect(buf, len);
 
   // Queue next RX transfer if still active
-  if (current_alt_setting > 0) {
+  if (current_alt_setting > 0 && sco_rx_size) {
     if (!usbd_edpt_busy(0, EPNUM_BT_ISO_OUT)) {
-      usbd_edpt_xfer(0, EPNUM_BT_ISO_OUT, sco_rx_buf, SCO_MAX_PACKET);
+      usbd_edpt_xfer(0, EPNUM_BT_ISO_OUT, sco_rx_buf, sco_rx_size);
     }
   }
 }
 
+// Core 0: forward host SCO packets to the CYW43
+void __not_in_flash_func(bt_sco_task)(void) {
+  sco_slot_t *s = ring_peek(&out_ring);
+  if (!s)
+    return;
+
+  cyw43_thread_enter();
+  while (s) {
+    if (sco_transport->send_packet(HCI_SCO_DATA_PACKET, s->data, s->len) != 0)
+      break; // Controller busy, retry next loop
+    sco_out_sent++;
+    ring_pop(&out_ring);
+    s = ring_peek(&out_ring);
+  }
+  cyw43_thread_exit();
+}
+
+void bt_sco_get_stats_and_reset(bt_sco_stats_t *out) {
+  // Windowed values are deltas of the monotonic counters
+  static uint32_t last_rx, last_out, last_drop, last_ins;
+  static uint32_t last_ovf, last_out_ovf;
+
+  uint32_t rx = sco_rx_count, rx_bytes = sco_rx_bytes, sent = sco_out_sent;
+  uint32_t dropped = sco_dropped, inserted = sco_inserted;
+  uint32_t frames = sco_sof_frames;
+  uint32_t ovf = sco_in_overflow, out_ovf = sco_out_overflow;
+  uint32_t out_bytes = sco_out_bytes;
+
+  // Consistent copy of the base; retry if an alt switch raced the read
+  uint32_t epoch, base_frames, base_rx_bytes, base_out_bytes;
+  do {
+    epoch = alt_epoch;
+    ROLE_BARRIER();
+    base_frames = alt_base_frames;
+    base_rx_bytes = alt_base_rx_bytes;
+    base_out_bytes = alt_base_out_bytes;
+    ROLE_BARRIER();
+  } while ((epoch & 1) || epoch != alt_epoch);
+
+  out->in_pkts = rx - last_rx;
+  out->out_pkts = sent - last_out;
+  out->dropped = (dropped - last_drop) + (ovf - last_ovf);
+  out->inserted = inserted - last_ins;
+  out->out_dropped = out_ovf - last_out_ovf;
+
+  // Drift: payload bytes from the controller vs. the nominal rate over the
+  // same number of USB frames, cumulative since the alt setting was selected
+  // so the one-packet phase error shrinks as the call goes on (positive =
+  // controller clock fast)
+  uint8_t alt = current_alt_setting;
+  uint32_t bytes_per_ms =
+      alt < CFG_TUD_BTH_ISO_ALT_COUNT ? sco_bytes_per_ms[alt] : 0;
+  int64_t expected = (int64_t)(frames - base_frames) * bytes_per_ms;
+  out->drift_ppm =
+      expected ? (int32_t)(((int64_t)(rx_bytes - base_rx_bytes) - expected) *
+                           1000000 / expected)
+               : 0;
+  // Same for the host's payload on ISO OUT (positive = host sends fast)
+  out->out_rate_ppm =
+      expected ? (int32_t)(((int64_t)(out_bytes - base_out_bytes) - expected) *
+                           1000000 / expected)
+               : 0;
+
+  out->level_min = level_samples ? level_min : 0;
+  out->level_max = level_max;
+  out->level_avg_x100 =
+      level_samples ? (uint16_t)(level_sum * 100 / level_samples) : 0;
+  out->out_level_max = out_level_max;
+  level_reset_req = true;
+
+  last_rx = rx;
+  last_out = sent;
+  last_drop = dropped;
+  last_ins = inserted;
+  last_ovf = ovf;
+  last_out_ovf = out_ovf;
+}
+
+bool bt_sco_set_levels(uint8_t target, uint8_t high) {
+  if (target == 0 || target > high || high >= SCO_RING_SIZE)
+    return false;
+  sco_levels = target | (high << 8);
+  return true;
+}
+
+void bt_sco_get_levels(uint8_t *target, uint8_t *high) {
+  uint16_t levels = sco_levels;
+  *target = levels & 0xFF;
+  *high = levels >> 8;
+}
+
 // Get SCO packet counts for stats
 uint32_t bt_sco_get_rx_count(void) { return sco_rx_count; }
 uint32_t bt_sco_get_tx_count(void) { return sco_tx_count; }
+
+// --- Voice interface: application class driver around TinyUSB's BTH ---
+
+// ISO endpoint descriptors per alt setting and direction (in the
+// configuration descriptor, which stays valid while configured)
+static tusb_desc_endpoint_t const *voice_ep[CFG_TUD_BTH_ISO_ALT_COUNT][2];
+
+static uint16_t bth_open(uint8_t rhport, tusb_desc_interface_t const *itf_desc,
+                         uint16_t max_len) {
+  uint16_t drv_len = btd_open(rhport, itf_desc, max_len);
+  if (drv_len == 0)
+    return 0;
+
+  // Record the voice endpoints of each alt setting
+  memset(voice_ep, 0, sizeof(voice_ep));
+  uint16_t largest[2] = {0, 0};
+  uint8_t alt = 0xFF;
+  uint8_t const *p = (uint8_t const *)itf_desc;
+  uint8_t const *end = p + drv_len;
+  for (; p < end; p = tu_desc_next(p)) {
+    if (tu_desc_type(p) == TUSB_DESC_INTERFACE) {
+      tusb_desc_interface_t const *itf = (tusb_desc_interface_t const *)p;
+      alt = itf->bInterfaceNumber == ITF_NUM_BTH_VOICE ? itf->bAlternateSetting
+                                                       : 0xFF;
+    } else if (tu_desc_type(p) == TUSB_DESC_ENDPOINT &&
+               alt < CFG_TUD_BTH_ISO_ALT_COUNT) {
+      tusb_desc_endpoint_t const *ep = (tusb_desc_endpoint_t const *)p;
+      uint8_t dir = tu_edpt_dir(ep->bEndpointAddress);
+      voice_ep[alt][dir] = ep;
+      if (tu_edpt_packet_size(ep) > largest[dir])
+        largest[dir] = tu_edpt_packet_size(ep);
+    }
+  }
+
+#ifdef TUP_DCD_EDPT_ISO_ALLOC
+  // Reserve endpoint buffers for the largest alt once; SET_INTERFACE only
+  // activates the endpoints with the selected packet size
+  usbd_edpt_close(rhport, EPNUM_BT_ISO_IN);
+  usbd_edpt_close(rhport, EPNUM_BT_ISO_OUT);
+  TU_ASSERT(usbd_edpt_iso_alloc(rhport, EPNUM_BT_ISO_IN,
+                                largest[TUSB_DIR_IN]), 0);
+  TU_ASSERT(usbd_edpt_iso_alloc(rhport, EPNUM_BT_ISO_OUT,
+                                largest[TUSB_DIR_OUT]), 0);
+#endif
+  bt_sco_set_alt_setting(0);
+  return drv_len;
+}
+
+static bool voice_set_alt(uint8_t rhport, uint8_t alt) {
+  if (alt >= CFG_TUD_BTH_ISO_ALT_COUNT)
+    return false;
+
+  usbd_edpt_close(rhport, EPNUM_BT_ISO_IN);
+  usbd_edpt_close(rhport, EPNUM_BT_ISO_OUT);
+  sco_rx_size = 0;
+  for (uint8_t dir = 0; dir < 2; dir++) {
+    tusb_desc_endpoint_t const *ep = voice_ep[alt][dir];
+    if (!ep || tu_edpt_packet_size(ep) == 0)
+      continue;
+#ifdef TUP_DCD_EDPT_ISO_ALLOC
+    TU_ASSERT(usbd_edpt_iso_activate(rhport, ep));
+#else
+    TU_ASSERT(usbd_edpt_open(rhport, ep));
+#endif
+    if (dir == TUSB_DIR_OUT)
+      sco_rx_size = tu_edpt_packet_size(ep);
+  }
+  bt_sco_set_alt_setting(alt);
+  return true;
+}
+
+static bool bth_control_xfer_cb(uint8_t rhport, uint8_t stage,
+                                tusb_control_request_t const *request) {
+  if (request->bmRequestType_bit.type != TUSB_REQ_TYPE_STANDARD ||
+      request->bmRequestType_bit.recipient != TUSB_REQ_RCPT_INTERFACE ||
+      tu_u16_low(request->wIndex) != ITF_NUM_BTH_VOICE)
+    return btd_control_xfer_cb(rhport, stage, request);
+
+  if (stage != CONTROL_STAGE_SETUP)
+    return true;
+  switch (request->bRequest) {
+  case TUSB_REQ_SET_INTERFACE:
+    if (!voice_set_alt(rhport, tu_u16_low(request->wValue)))
+      return false;
+    return tud_control_status(rhport, request);
+  case TUSB_REQ_GET_INTERFACE: {
+    static uint8_t alt;
+    alt = current_alt_setting;
+    return tud_control_xfer(rhport, request, &alt, 1);
+  }
+  default:
+    return false;
+  }
+}
+
+static bool __not_in_flash_func(bth_xfer_cb)(uint8_t rhport, uint8_t ep_addr,
+                                             xfer_result_t result,
+                                             uint32_t xferred_bytes) {
+  if (ep_addr == EPNUM_BT_ISO_IN) {
+    bt_sco_tx_complete();
+    return true;
+  }
+  if (ep_addr == EPNUM_BT_ISO_OUT) {
+    bt_sco_rx_complete(sco_rx_buf, result == XFER_RESULT_SUCCESS
+                                       ? (uint16_t)xferred_bytes
+                                       : 0);
+    return true;
+  }
+  return btd_xfer_cb(rhport, ep_addr, result, xferred_bytes);
+}
+
+static usbd_class_driver_t const bth_driver = {
+#if CFG_TUSB_DEBUG >= 2
+    .name = "BTH+VOICE",
+#endif
+    .init = btd_init,
+    .deinit = btd_deinit,
+    .reset = btd_reset,
+    .open = bth_open,
+    .control_xfer_cb = bth_control_xfer_cb,
+    .xfer_cb = bth_xfer_cb,
+    .sof = NULL,
+};
+
+// Application drivers are tried before the built-in ones, so this claims
+// the BTH interfaces and the stock driver stays unused
+usbd_class_driver_t const *usbd_app_driver_get_cb(uint8_t *driver_count) {
+  *driver_count = 1;
+  return &bth_driver;
+}
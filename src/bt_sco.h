@@ -1,7 +1,11 @@
 // bt_sco.h - SCO (Voice) packet handling for BT dongle
+// ISO IN is paced from the USB SOF on Core 1 with drop/repeat drift
+// compensation; ISO OUT is reassembled into SCO packets and only measured.
+// See bt_sco.c
 #ifndef BT_SCO_H
 #define BT_SCO_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 // Initialize SCO module
@@ -11,6 +15,13 @@ void bt_sco_init(void);
 void bt_sco_set_alt_setting(uint8_t alt);
 uint8_t bt_sco_get_alt_setting(void);
 
+// Host's HCI_Write_Voice_Setting, snooped from the command stream (USB side).
+// With transparent air coding (bits 1:0 = 3) the SCO payload is the host's
+// codec output, e.g. mSBC; otherwise the controller codes the air format
+// (CVSD) from linear PCM itself.
+#define BT_SCO_VOICE_SETTING_DEFAULT 0x0060 // Linear 16-bit input, CVSD air
+void bt_sco_set_voice_setting(uint16_t setting);
+
 // Handle incoming SCO packet from CYW43 chip (RX: CYW43 → USB)
 void bt_sco_rx_packet(const uint8_t *packet, uint16_t size);
 
@@ -18,7 +29,37 @@ void bt_sco_rx_packet(const uint8_t *packet, uint16_t size);
 void bt_sco_tx_complete(void);
 void bt_sco_rx_complete(uint8_t *buf, uint16_t len);
 
+// Core 0: forward host SCO packets (ISO OUT) to the CYW43
+void bt_sco_task(void);
+
+// SCO ring depth in packets (power of 2)
+#define SCO_RING_SIZE 8
+
+// IN ring fill levels (packets): prefill target and drop watermark.
+// Requires 1 <= target <= high < SCO_RING_SIZE; returns false otherwise.
+bool bt_sco_set_levels(uint8_t target, uint8_t high);
+void bt_sco_get_levels(uint8_t *target, uint8_t *high);
+
 // Stats
+typedef struct {
+  uint32_t in_pkts;        // CYW43 -> USB packets received
+  uint32_t out_pkts;       // USB -> CYW43 packets forwarded
+  uint32_t dropped;        // IN: dropped to bound latency (or ring full)
+  uint32_t inserted;       // Repeated on underrun
+  int32_t drift_ppm;       // Controller SCO clock vs. USB SOF clock (since
+                           // the alt setting was selected)
+  uint8_t level_min;       // IN ring level (packets) sampled at each SOF
+  uint8_t level_max;
+  uint16_t level_avg_x100;
+  uint32_t out_dropped;    // OUT: host packets dropped, ring full
+  int32_t out_rate_ppm;    // Host SCO payload rate vs. USB SOF clock (same)
+  uint8_t out_level_max;   // OUT ring level (packets) after each push
+} bt_sco_stats_t;
+
+// Windowed stats since the previous call; the two rates are cumulative over
+// the current alt setting (Core 0)
+void bt_sco_get_stats_and_reset(bt_sco_stats_t *out);
+
 uint32_t bt_sco_get_rx_count(void);
 uint32_t bt_sco_get_tx_count(void);
 
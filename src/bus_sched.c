@@ -0,0 +1,79 @@
+// bus_sched.c - Deferred CYW43 bus access for housekeeping operations
+#include "bus_sched.h"
+#include "hardware/timer.h"
+#include "hci_packet_queue.h"
+#include "pico/cyw43_arch.h"
+#include <string.h>
+
+#define BUS_SCHED_GPIO_COUNT 3 // CYW43 WL_GPIO 0..2
+
+typedef struct {
+  bool want;
+  bool cur; // Level last written to the chip
+  bool pending;
+} gpio_op_t;
+
+static gpio_op_t gpio_ops[BUS_SCHED_GPIO_COUNT];
+static uint8_t pending_count = 0;
+static uint32_t oldest_us = 0;
+static bus_sched_stats_t stats;
+
+void bus_sched_init(void) {
+  memset(gpio_ops, 0, sizeof(gpio_ops));
+  pending_count = 0;
+  memset(&stats, 0, sizeof(stats));
+}
+
+void bus_sched_gpio_put(uint32_t pin, bool value) {
+  if (pin >= BUS_SCHED_GPIO_COUNT)
+    return;
+  gpio_op_t *op = &gpio_ops[pin];
+  stats.requested++;
+  op->want = value;
+  if (op->pending) {
+    stats.coalesced++;
+    return;
+  }
+  op->pending = true;
+  if (pending_count++ == 0)
+    oldest_us = time_us_32();
+}
+
+void __not_in_flash_func(bus_sched_task)(void) {
+  if (pending_count == 0)
+    return;
+
+  // Bluetooth traffic first: wait for both TX queues to drain
+  bool idle = !hci_tx_peek() && !hci_tx_prio_peek();
+  if (!idle) {
+    if (time_us_32() - oldest_us < BUS_SCHED_MAX_DEFER_US)
+      return;
+    stats.forced++;
+  }
+
+  uint32_t start = time_us_32();
+  for (uint32_t pin = 0; pin < BUS_SCHED_GPIO_COUNT; pin++) {
+    gpio_op_t *op = &gpio_ops[pin];
+    if (!op->pending)
+      continue;
+    op->pending = false;
+    if (op->want == op->cur) {
+      stats.coalesced++;
+      continue;
+    }
+    cyw43_arch_gpio_put(pin, op->want);
+    op->cur = op->want;
+    stats.executed++;
+  }
+  pending_count = 0;
+
+  uint32_t dur = time_us_32() - start;
+  stats.bus_us += dur;
+  if (dur > stats.max_us)
+    stats.max_us = dur;
+}
+
+void bus_sched_get_stats_and_reset(bus_sched_stats_t *stats_out) {
+  *stats_out = stats;
+  memset(&stats, 0, sizeof(stats));
+}
@@ -0,0 +1,37 @@
+// bus_sched.h - Deferred CYW43 bus access for housekeeping operations
+// The CYW43 WL GPIOs (activity LED) sit behind the same gSPI bus as the
+// Bluetooth traffic. Housekeeping writes are recorded here and performed
+// by bus_sched_task() in the Core 0 loop only when both TX queues are
+// empty, so they never delay a send_packet(). Repeated writes to a pin
+// coalesce into one bus transaction (none if the pin ends up unchanged).
+// Core 0 only.
+#ifndef BUS_SCHED_H
+#define BUS_SCHED_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Longest a write may wait for an idle gap under continuous traffic; it
+// is then performed between TX bus sessions
+#define BUS_SCHED_MAX_DEFER_US 250000
+
+typedef struct {
+  uint32_t requested; // Writes requested
+  uint32_t coalesced; // Requests merged or cancelled without bus access
+  uint32_t executed;  // Bus transactions performed
+  uint32_t forced;    // Of which ran past BUS_SCHED_MAX_DEFER_US
+  uint32_t bus_us;    // Bus time spent on housekeeping
+  uint32_t max_us;
+} bus_sched_stats_t;
+
+void bus_sched_init(void);
+
+// Request a CYW43 WL GPIO level (e.g. CYW43_WL_GPIO_LED_PIN)
+void bus_sched_gpio_put(uint32_t pin, bool value);
+
+// Perform pending writes if the TX path is idle (or the deadline passed)
+void bus_sched_task(void);
+
+void bus_sched_get_stats_and_reset(bus_sched_stats_t *stats_out);
+
+#endif // BUS_SCHED_H
@@ -1,91 +1,221 @@
 #include "hci_packet_queue.h"
 #include "hardware/sync.h"
+#include "hardware/timer.h"
 #include "pico.h"
+#include "placement.h"
+#include "topology.h"
+#include "trace.h"
 #include <string.h>
 
+// Indices and stats are placed with the role that writes them: RX is
+// produced by the CYW43 side and consumed by the USB side, TX the other way
+// round.
+
+// HCI packet types / events used for admission classes
+#define HCI_PKT_ACL 0x02
+#define HCI_PKT_EVENT 0x04
+#define HCI_EVT_INQUIRY_RESULT 0x02
+#define HCI_EVT_INQUIRY_RESULT_RSSI 0x22
+#define HCI_EVT_EXT_INQUIRY_RESULT 0x2F
+#define HCI_EVT_LE_META 0x3E
+#define HCI_SUBEVT_LE_ADV_REPORT 0x02
+#define HCI_SUBEVT_LE_DIRECTED_ADV_REPORT 0x0B
+#define HCI_SUBEVT_LE_EXT_ADV_REPORT 0x0D
+
+// Admission reserves (written by configuration, read by both producers)
+static volatile uint8_t reserve_critical = HCI_QUEUE_RESERVE_CRITICAL;
+static volatile uint8_t reserve_acl = HCI_QUEUE_RESERVE_ACL;
+
 // --- RX QUEUE (Upstream) ---
 static __attribute__((aligned(4))) hci_packet_entry_t rx_q[HCI_PACKET_QUEUE_SIZE];
-static volatile uint8_t rx_head = 0;
-static volatile uint8_t rx_tail = 0;
-static volatile queue_direction_stats_t rx_stats = {0};
+static volatile uint8_t CYW43_CORE_DATA("rx_head") rx_head = 0;
+static volatile uint8_t USB_CORE_DATA("rx_tail") rx_tail = 0;
+static volatile queue_direction_stats_t CYW43_CORE_DATA("rx_stats")
+    rx_stats = {0};
 
 // --- TX QUEUE (Downstream) ---
 static __attribute__((aligned(4))) hci_packet_entry_t tx_q[HCI_PACKET_QUEUE_SIZE];
-static volatile uint8_t tx_head = 0;
-static volatile uint8_t tx_tail = 0;
-static volatile queue_direction_stats_t tx_stats = {0};
+static volatile uint8_t USB_CORE_DATA("tx_head") tx_head = 0;
+static volatile uint8_t CYW43_CORE_DATA("tx_tail") tx_tail = 0;
+static volatile queue_direction_stats_t USB_CORE_DATA("tx_stats")
+    tx_stats = {0};
+
+// --- TX PRIORITY QUEUE (Downstream, A2DP media link) ---
+static __attribute__((aligned(4)))
+hci_packet_entry_t txp_q[HCI_PACKET_PRIO_QUEUE_SIZE];
+static volatile uint8_t USB_CORE_DATA("txp_head") txp_head = 0;
+static volatile uint8_t CYW43_CORE_DATA("txp_tail") txp_tail = 0;
+static volatile queue_direction_stats_t USB_CORE_DATA("txp_stats")
+    txp_stats = {0};
 
 void hci_packet_queue_init(void) {
   rx_head = rx_tail = 0;
   tx_head = tx_tail = 0;
+  txp_head = txp_tail = 0;
   memset((void *)&rx_stats, 0, sizeof(rx_stats));
   memset((void *)&tx_stats, 0, sizeof(tx_stats));
+  memset((void *)&txp_stats, 0, sizeof(txp_stats));
+}
+
+bool hci_packet_queue_set_reserves(uint8_t critical, uint8_t acl) {
+  if (critical + acl >= HCI_PACKET_QUEUE_SIZE - 1)
+    return false;
+  reserve_critical = critical;
+  reserve_acl = acl;
+  return true;
+}
+
+void hci_packet_queue_get_reserves(uint8_t *critical, uint8_t *acl) {
+  *critical = reserve_critical;
+  *acl = reserve_acl;
+}
+
+hci_packet_class_t __not_in_flash_func(hci_packet_class)(uint8_t packet_type,
+                                                         const uint8_t *data,
+                                                         uint16_t size) {
+  if (packet_type == HCI_PKT_ACL)
+    return HCI_CLASS_ACL;
+  if (packet_type != HCI_PKT_EVENT || size < 1)
+    return HCI_CLASS_CRITICAL;
+
+  switch (data[0]) {
+  case HCI_EVT_INQUIRY_RESULT:
+  case HCI_EVT_INQUIRY_RESULT_RSSI:
+  case HCI_EVT_EXT_INQUIRY_RESULT:
+    return HCI_CLASS_DISCARDABLE;
+  case HCI_EVT_LE_META:
+    if (size >= 3 && (data[2] == HCI_SUBEVT_LE_ADV_REPORT ||
+                      data[2] == HCI_SUBEVT_LE_DIRECTED_ADV_REPORT ||
+                      data[2] == HCI_SUBEVT_LE_EXT_ADV_REPORT))
+      return HCI_CLASS_DISCARDABLE;
+    return HCI_CLASS_CRITICAL;
+  default:
+    return HCI_CLASS_CRITICAL;
+  }
 }
 
 // GENERIC HELPERS (Inline for speed)
-static inline bool enqueue(hci_packet_entry_t *q, volatile uint8_t *head,
-                           volatile uint8_t tail,
+static inline uint8_t depth_of(uint8_t head, uint8_t tail, uint8_t qsize) {
+  return (head >= tail) ? (head - tail) : ((qsize - tail) + head);
+}
+
+// May a packet of this class take one of the last free_slots slots?
+static inline bool admit(uint8_t free_slots, hci_packet_class_t cls) {
+  switch (cls) {
+  case HCI_CLASS_CRITICAL:
+    return free_slots > 0;
+  case HCI_CLASS_ACL:
+    return free_slots > reserve_critical;
+  default:
+    return free_slots > reserve_critical + reserve_acl;
+  }
+}
+
+static inline bool enqueue(hci_packet_entry_t *q, uint8_t qsize,
+                           volatile uint8_t *head, volatile uint8_t tail,
                            volatile queue_direction_stats_t *stats,
-                           uint8_t type, const uint8_t *data, uint16_t size) {
-  uint8_t next_head = (*head + 1) % HCI_PACKET_QUEUE_SIZE;
-  if (next_head == tail) {
-    stats->drops++;
-    return false;
+                           bool admission, uint8_t type, const uint8_t *data,
+                           uint16_t size) {
+  uint8_t next_head = (*head + 1) % qsize;
+  uint8_t depth = depth_of(*head, tail, qsize);
+  uint8_t free_slots = qsize - 1 - depth;
+
+  // Classify only when the queue is into its reserved headroom. Without
+  // admission (the A2DP prio queue, media ACL only) this is a full queue.
+  uint8_t reserved = admission ? reserve_critical + reserve_acl : 0;
+  if (free_slots <= reserved) {
+    hci_packet_class_t cls =
+        admission ? hci_packet_class(type, data, size) : HCI_CLASS_ACL;
+    if (!admit(free_slots, cls)) {
+      stats->drops++;
+      stats->class_drops[cls]++;
+      return false;
+    }
   }
 
   // Stats
   stats->total++;
   stats->bytes += size;
-  uint8_t depth = (*head >= tail) ? (*head - tail)
-                                  : ((HCI_PACKET_QUEUE_SIZE - tail) + *head);
   depth++; // Include this one
   if (depth > stats->peak_depth) stats->peak_depth = depth;
 
   hci_packet_entry_t *entry = &q[*head];
+  entry->enq_us = time_us_32();
   entry->packet_type = type;
   if (size > HCI_PACKET_MAX_SIZE) size = HCI_PACKET_MAX_SIZE;
   entry->size = size;
   memcpy(entry->data, data, size);
 
-  __dmb();
+  ROLE_BARRIER();
   *head = next_head;
   return true;
 }
 
 static inline hci_packet_entry_t *peek(hci_packet_entry_t *q, volatile uint8_t head, volatile uint8_t tail) {
   if (head == tail) return NULL;
-  __dmb();
+  ROLE_BARRIER();
   return &q[tail];
 }
 
-static inline void advance(volatile uint8_t *tail, volatile uint8_t head) {
+static inline void advance(volatile uint8_t *tail, volatile uint8_t head,
+                           uint8_t qsize) {
   if (head == *tail)
     return;
-  __dmb();
-  *tail = (*tail + 1) % HCI_PACKET_QUEUE_SIZE;
+  ROLE_BARRIER();
+  *tail = (*tail + 1) % qsize;
 }
 
 // --- RX IMPLEMENTATION ---
 bool __not_in_flash_func(hci_rx_enqueue)(uint8_t type, const uint8_t *data,
                                          uint16_t size) {
-  return enqueue(rx_q, &rx_head, rx_tail, &rx_stats, type, data, size);
+  bool ok = enqueue(rx_q, HCI_PACKET_QUEUE_SIZE, &rx_head, rx_tail, &rx_stats,
+                    true, type, data, size);
+  TRACE(ok ? TRACE_EV_RX_ENQUEUE : TRACE_EV_QUEUE_DROP, ok ? size : 0);
+  return ok;
 }
 hci_packet_entry_t *__not_in_flash_func(hci_rx_peek)(void) {
   return peek(rx_q, rx_head, rx_tail);
 }
-void __not_in_flash_func(hci_rx_free)(void) { advance(&rx_tail, rx_head); }
+void __not_in_flash_func(hci_rx_free)(void) {
+  TRACE(TRACE_EV_RX_DEQUEUE, 0);
+  advance(&rx_tail, rx_head, HCI_PACKET_QUEUE_SIZE);
+}
 
 // --- TX IMPLEMENTATION ---
 bool __not_in_flash_func(hci_tx_enqueue)(uint8_t type, const uint8_t *data,
                                          uint16_t size) {
-  return enqueue(tx_q, &tx_head, tx_tail, &tx_stats, type, data, size);
+  bool ok = enqueue(tx_q, HCI_PACKET_QUEUE_SIZE, &tx_head, tx_tail, &tx_stats,
+                    true, type, data, size);
+  TRACE(ok ? TRACE_EV_TX_ENQUEUE : TRACE_EV_QUEUE_DROP, ok ? size : 1);
+  return ok;
 }
 hci_packet_entry_t *__not_in_flash_func(hci_tx_peek)(void) {
   return peek(tx_q, tx_head, tx_tail);
 }
-void __not_in_flash_func(hci_tx_free)(void) { advance(&tx_tail, tx_head); }
+void __not_in_flash_func(hci_tx_free)(void) {
+  TRACE(TRACE_EV_TX_DEQUEUE, 0);
+  advance(&tx_tail, tx_head, HCI_PACKET_QUEUE_SIZE);
+}
+
+// --- TX PRIORITY IMPLEMENTATION ---
+bool __not_in_flash_func(hci_tx_prio_enqueue)(uint8_t type,
+                                              const uint8_t *data,
+                                              uint16_t size) {
+  // A2DP media ACL only: no admission classes
+  bool ok = enqueue(txp_q, HCI_PACKET_PRIO_QUEUE_SIZE, &txp_head, txp_tail,
+                    &txp_stats, false, type, data, size);
+  TRACE(ok ? TRACE_EV_TX_ENQUEUE : TRACE_EV_QUEUE_DROP, ok ? size : 1);
+  return ok;
+}
+hci_packet_entry_t *__not_in_flash_func(hci_tx_prio_peek)(void) {
+  return peek(txp_q, txp_head, txp_tail);
+}
+void __not_in_flash_func(hci_tx_prio_free)(void) {
+  TRACE(TRACE_EV_TX_DEQUEUE, 1);
+  advance(&txp_tail, txp_head, HCI_PACKET_PRIO_QUEUE_SIZE);
+}
 
-void hci_tx_signal_busy(void) { tx_stats.driver_busy++; }
+void __not_in_flash_func(hci_tx_signal_busy)(void) { tx_stats.driver_busy++; }
 
 // DIAGNOSTICS
 void hci_packet_queue_get_stats_and_reset(queue_stats_t *stats_out) {
@@ -93,16 +223,22 @@ void hci_packet_queue_get_stats_and_reset(queue_stats_t *stats_out) {
 
   stats_out->rx = (queue_direction_stats_t)rx_stats; // Copy struct
   stats_out->tx = (queue_direction_stats_t)tx_stats;
+  stats_out->tx_prio = (queue_direction_stats_t)txp_stats;
 
   // Calc current depths
   stats_out->rx.current_depth =
-      (rx_head >= rx_tail) ? (rx_head - rx_tail)
-                           : (HCI_PACKET_QUEUE_SIZE - rx_tail + rx_head);
+      depth_of(rx_head, rx_tail, HCI_PACKET_QUEUE_SIZE);
   stats_out->tx.current_depth =
-      (tx_head >= tx_tail) ? (tx_head - tx_tail)
-                           : (HCI_PACKET_QUEUE_SIZE - tx_tail + tx_head);
+      depth_of(tx_head, tx_tail, HCI_PACKET_QUEUE_SIZE);
+  stats_out->tx_prio.current_depth =
+      depth_of(txp_head, txp_tail, HCI_PACKET_PRIO_QUEUE_SIZE);
 
   // Reset Counters
+  for (int i = 0; i < HCI_CLASS_COUNT; i++) {
+    rx_stats.class_drops[i] = 0;
+    tx_stats.class_drops[i] = 0;
+    txp_stats.class_drops[i] = 0;
+  }
   rx_stats.total = 0;
   rx_stats.drops = 0;
   rx_stats.peak_depth = 0;
@@ -113,9 +249,89 @@ void hci_packet_queue_get_stats_and_reset(queue_stats_t *stats_out) {
   tx_stats.peak_depth = 0;
   tx_stats.bytes = 0;
   tx_stats.driver_busy = 0;
+  txp_stats.total = 0;
+  txp_stats.drops = 0;
+  txp_stats.peak_depth = 0;
+  txp_stats.bytes = 0;
+  txp_stats.driver_busy = 0;
 
   restore_interrupts(flags);
 }
 
+void hci_packet_queue_get_depths(uint8_t *rx, uint8_t *tx, uint8_t *tx_prio) {
+  *rx = depth_of(rx_head, rx_tail, HCI_PACKET_QUEUE_SIZE);
+  *tx = depth_of(tx_head, tx_tail, HCI_PACKET_QUEUE_SIZE);
+  *tx_prio = depth_of(txp_head, txp_tail, HCI_PACKET_PRIO_QUEUE_SIZE);
+}
+
 // Get current TX bytes (for LED activity indicator)
-uint32_t hci_tx_get_bytes(void) { return tx_stats.bytes; }
\ No newline at end of file
+uint32_t __not_in_flash_func(hci_tx_get_bytes)(void) {
+  return tx_stats.bytes + txp_stats.bytes;
+}
+#if DONGLE_QUEUE_BENCH
+#include "hardware/structs/systick.h"
+#include "pico/multicore.h"
+#include <stdio.h>
+
+#define QBENCH_ITERS 256
+#define QBENCH_ACL_PACKET 0x02
+
+static inline uint32_t systick_now(void) { return systick_hw->cvr; }
+
+#if USB_CORE != CYW43_CORE
+// Core 1 stand-in: streams through striped main SRAM like the USB path does
+static void __not_in_flash_func(qbench_core1_load)(void) {
+  static uint8_t scratch[4096];
+  uint8_t v = 0;
+  while (1)
+    memset(scratch, v++, sizeof(scratch));
+}
+#endif
+
+static void qbench_pass(const char *label) {
+  static uint8_t payload[HCI_PACKET_MAX_SIZE];
+  static const uint16_t sizes[] = {16, 64, 259, 1021};
+
+  for (unsigned s = 0; s < count_of(sizes); s++) {
+    uint32_t enq = 0, deq = 0;
+    for (int i = 0; i < QBENCH_ITERS; i++) {
+      uint32_t t0 = systick_now();
+      hci_tx_enqueue(QBENCH_ACL_PACKET, payload, sizes[s]);
+      uint32_t t1 = systick_now();
+      if (hci_tx_peek())
+        hci_tx_free();
+      uint32_t t2 = systick_now();
+      // SysTick counts down
+      enq += (t0 - t1) & 0x00FFFFFF;
+      deq += (t1 - t2) & 0x00FFFFFF;
+    }
+    printf("QBENCH %-5s: %4u B  enqueue=%lu cyc  peek+free=%lu cyc\n", label,
+           sizes[s], (unsigned long)(enq / QBENCH_ITERS),
+           (unsigned long)(deq / QBENCH_ITERS));
+  }
+}
+
+// Cycle cost of the queue hot path, with Core 1 idle and with Core 1 loading
+// main SRAM. Compare builds with DONGLE_SRAM_PLACEMENT on and off, and the
+// SINGLE topology (compiler barrier only) against DUAL. SINGLE never runs
+// Core 1, so it has no load pass.
+// Must run before Core 1 is launched; resets the queues afterwards.
+void hci_packet_queue_bench(void) {
+  systick_hw->csr = 0;
+  systick_hw->rvr = 0x00FFFFFF;
+  systick_hw->cvr = 0;
+  systick_hw->csr = 0x5; // Enable, processor clock
+
+  printf("QBENCH     : SRAM placement %s  Topology %s\n",
+         DONGLE_SRAM_PLACEMENT ? "on" : "off", DONGLE_TOPOLOGY_NAME);
+  qbench_pass("idle");
+#if USB_CORE != CYW43_CORE
+  multicore_launch_core1(qbench_core1_load);
+  qbench_pass("load");
+  multicore_reset_core1();
+#endif
+
+  systick_hw->csr = 0;
+  hci_packet_queue_init();
+}
+#endif // DONGLE_QUEUE_BENCH
@@ -6,10 +6,51 @@
 #include <stdint.h>
 
 // 64 * 1KB = 64KB per queue (128KB total). Safe for Pico 2.
-#define HCI_PACKET_QUEUE_SIZE 64
+// Pico W (RP2040, 264KB SRAM shared with CYW43/BTstack buffers and the
+// flash-resident build's RAM functions): 24 + 24 + 8 entries (~58KB).
 #define HCI_PACKET_MAX_SIZE 1024
+#if PICO_RP2040
+#ifndef HCI_PACKET_QUEUE_SIZE
+#define HCI_PACKET_QUEUE_SIZE 24
+#endif
+#ifndef HCI_PACKET_PRIO_QUEUE_SIZE
+#define HCI_PACKET_PRIO_QUEUE_SIZE 8
+#endif
+#ifndef HCI_QUEUE_RESERVE_CRITICAL
+#define HCI_QUEUE_RESERVE_CRITICAL 2
+#endif
+#ifndef HCI_QUEUE_RESERVE_ACL
+#define HCI_QUEUE_RESERVE_ACL 4
+#endif
+#endif
+#ifndef HCI_PACKET_QUEUE_SIZE
+#define HCI_PACKET_QUEUE_SIZE 64
+#endif
+// Priority TX queue for the A2DP media link (see bt_a2dp.h)
+#ifndef HCI_PACKET_PRIO_QUEUE_SIZE
+#define HCI_PACKET_PRIO_QUEUE_SIZE 16
+#endif
+
+// Admission control (RX and TX queues): the last RESERVE_CRITICAL free
+// slots only admit commands and non-discardable events; the
+// RESERVE_ACL slots before them also admit ACL data. Discardable events
+// (advertising / inquiry results) are shed first as a queue fills.
+#ifndef HCI_QUEUE_RESERVE_CRITICAL
+#define HCI_QUEUE_RESERVE_CRITICAL 4
+#endif
+#ifndef HCI_QUEUE_RESERVE_ACL
+#define HCI_QUEUE_RESERVE_ACL 8
+#endif
+
+typedef enum {
+  HCI_CLASS_CRITICAL = 0, // Commands, events other than below
+  HCI_CLASS_ACL,          // ACL data
+  HCI_CLASS_DISCARDABLE,  // LE advertising reports, inquiry results
+  HCI_CLASS_COUNT
+} hci_packet_class_t;
 
 typedef struct __attribute__((aligned(4))) {
+  uint32_t enq_us; // time_us_32() at enqueue (scheduling, residency)
   uint8_t packet_type;
   uint16_t size;
   uint8_t _pre_buffer[4]; // Reserved for CYW43 HCI header
@@ -21,18 +62,28 @@ typedef struct {
   uint32_t total;
   uint32_t bytes;
   uint32_t drops;
+  uint32_t class_drops[HCI_CLASS_COUNT];
   uint32_t driver_busy;
   uint32_t peak_depth;
   uint32_t current_depth;
 } queue_direction_stats_t;
 
 typedef struct {
-  queue_direction_stats_t rx; // Chip -> USB
-  queue_direction_stats_t tx; // USB -> Chip
+  queue_direction_stats_t rx;      // Chip -> USB
+  queue_direction_stats_t tx;      // USB -> Chip
+  queue_direction_stats_t tx_prio; // USB -> Chip (A2DP media link)
 } queue_stats_t;
 
 void hci_packet_queue_init(void);
 
+hci_packet_class_t hci_packet_class(uint8_t packet_type, const uint8_t *data,
+                                    uint16_t size);
+
+// Runtime admission reserves (slots). Rejected if they leave no room for
+// discardable packets in the smaller of the RX/TX queues.
+bool hci_packet_queue_set_reserves(uint8_t critical, uint8_t acl);
+void hci_packet_queue_get_reserves(uint8_t *critical, uint8_t *acl);
+
 // --- RX (Upstream: Chip -> USB) ---
 bool __not_in_flash_func(hci_rx_enqueue)(uint8_t packet_type,
                                          const uint8_t *data, uint16_t size);
@@ -45,8 +96,21 @@ bool __not_in_flash_func(hci_tx_enqueue)(uint8_t packet_type,
 hci_packet_entry_t *__not_in_flash_func(hci_tx_peek)(void);
 void __not_in_flash_func(hci_tx_free)(void);
 
+// --- TX Priority (Downstream, A2DP media link) ---
+bool __not_in_flash_func(hci_tx_prio_enqueue)(uint8_t packet_type,
+                                              const uint8_t *data,
+                                              uint16_t size);
+hci_packet_entry_t *__not_in_flash_func(hci_tx_prio_peek)(void);
+void __not_in_flash_func(hci_tx_prio_free)(void);
+
 // Diagnostics
 void hci_packet_queue_get_stats_and_reset(queue_stats_t *stats_out);
+void hci_packet_queue_get_depths(uint8_t *rx, uint8_t *tx, uint8_t *tx_prio);
+
+#if DONGLE_QUEUE_BENCH
+// Boot-time cycle benchmark of the queue hot path (before Core 1 launch)
+void hci_packet_queue_bench(void);
+#endif
 
 void hci_tx_signal_busy(void);
 
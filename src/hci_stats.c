@@ -0,0 +1,320 @@
+// hci_stats.c - HCI command latency and per-connection accounting
+//
+// Ownership: the opcode table and the connection handles are written only
+// on Core 0. Core 1 hands command arrivals over through a small SPSC log.
+// Per-connection counters are split by writer core; Core 1 counters are
+// cleared by Core 1 on request (c1_reset_req), like the loop profiles.
+#include "hci_stats.h"
+#include "btstack.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+#include "pico.h"
+#include "topology.h"
+#include <string.h>
+
+#define NO_HANDLE 0xFFFF
+#define CMD_LOG_SIZE 16 // Power of 2
+
+// HCI events
+#define HCI_EVT_CONN_COMPLETE 0x03
+#define HCI_EVT_DISCONN_COMPLETE 0x05
+#define HCI_EVT_CMD_COMPLETE 0x0E
+#define HCI_EVT_CMD_STATUS 0x0F
+#define HCI_EVT_LE_META 0x3E
+#define HCI_SUBEVT_LE_CONN_COMPLETE 0x01
+#define HCI_SUBEVT_LE_ENH_CONN_COMPLETE 0x0A
+
+typedef struct {
+  uint16_t opcode;
+  uint32_t us;
+} cmd_log_entry_t;
+
+typedef struct {
+  hci_cmd_stats_t s;
+  bool pending;
+  uint32_t issue_us;
+} cmd_slot_t;
+
+typedef struct {
+  volatile uint16_t handle; // Core 0
+  // Core 0: rx.pkts/bytes/drops, tx.res_*
+  // Core 1: tx.pkts/bytes/drops, rx.res_*
+  hci_conn_stats_t s;
+  volatile bool c1_reset_req;
+} conn_slot_t;
+
+// Core 1 -> Core 0 command arrival log
+static cmd_log_entry_t cmd_log[CMD_LOG_SIZE];
+static volatile uint8_t cmd_log_head = 0; // Core 1
+static volatile uint8_t cmd_log_tail = 0; // Core 0
+static volatile uint32_t cmd_log_overflow = 0; // Core 1, monotonic
+
+// Core 0
+static cmd_slot_t cmds[HCI_STATS_MAX_OPCODES];
+static uint32_t cmds_untracked = 0;
+static uint32_t cmd_log_overflow_seen = 0;
+static conn_slot_t conns[HCI_STATS_MAX_CONNS];
+static volatile bool reset_req = false;
+
+static inline uint16_t rd16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+void hci_stats_init(void) {
+  memset(cmds, 0, sizeof(cmds));
+  memset(conns, 0, sizeof(conns));
+  for (int i = 0; i < HCI_STATS_MAX_CONNS; i++)
+    conns[i].handle = NO_HANDLE;
+  cmd_log_head = cmd_log_tail = 0;
+  cmd_log_overflow = 0;
+  cmd_log_overflow_seen = 0;
+  cmds_untracked = 0;
+  reset_req = false;
+}
+
+void hci_stats_reset(void) { reset_req = true; }
+
+static conn_slot_t *__not_in_flash_func(find_conn)(uint16_t handle) {
+  for (int i = 0; i < HCI_STATS_MAX_CONNS; i++) {
+    if (conns[i].handle == handle)
+      return &conns[i];
+  }
+  return NULL;
+}
+
+static inline void clear_counts(hci_conn_dir_stats_t *d) {
+  d->pkts = 0;
+  d->bytes = 0;
+  d->drops = 0;
+}
+
+static inline void clear_residency(hci_conn_dir_stats_t *d) {
+  d->res_max_us = 0;
+  d->res_sum_us = 0;
+  d->res_n = 0;
+}
+
+static inline void __not_in_flash_func(residency)(hci_conn_dir_stats_t *d,
+                                                  uint32_t enq_us) {
+  uint32_t us = time_us_32() - enq_us;
+  d->res_sum_us += us;
+  d->res_n++;
+  if (us > d->res_max_us)
+    d->res_max_us = us;
+}
+
+// --- Core 1 ---
+
+void __not_in_flash_func(hci_stats_cmd_issued)(uint16_t opcode) {
+  uint8_t head = cmd_log_head;
+  if ((uint8_t)(head - cmd_log_tail) >= CMD_LOG_SIZE) {
+    cmd_log_overflow++;
+    return;
+  }
+  cmd_log_entry_t *e = &cmd_log[head & (CMD_LOG_SIZE - 1)];
+  e->opcode = opcode;
+  e->us = time_us_32();
+  ROLE_BARRIER();
+  cmd_log_head = head + 1;
+}
+
+static void __not_in_flash_func(conn_c1_sync)(conn_slot_t *c) {
+  if (!c->c1_reset_req)
+    return;
+  clear_counts(&c->s.tx);
+  clear_residency(&c->s.rx);
+  ROLE_BARRIER();
+  c->c1_reset_req = false;
+}
+
+void __not_in_flash_func(hci_stats_acl_tx)(const uint8_t *packet,
+                                           uint16_t size, bool queued) {
+  conn_slot_t *c = size >= 4 ? find_conn(rd16(packet) & 0x0FFF) : NULL;
+  if (!c)
+    return;
+  conn_c1_sync(c);
+  if (queued) {
+    c->s.tx.pkts++;
+    c->s.tx.bytes += size;
+  } else {
+    c->s.tx.drops++;
+  }
+}
+
+void __not_in_flash_func(hci_stats_rx_sent)(const hci_packet_entry_t *entry) {
+  if (entry->packet_type != HCI_ACL_DATA_PACKET || entry->size < 4)
+    return;
+  conn_slot_t *c = find_conn(rd16(entry->data) & 0x0FFF);
+  if (!c)
+    return;
+  conn_c1_sync(c);
+  residency(&c->s.rx, entry->enq_us);
+}
+
+// --- Core 0 ---
+
+static cmd_slot_t *__not_in_flash_func(cmd_slot)(uint16_t opcode,
+                                                 bool alloc) {
+  cmd_slot_t *free_slot = NULL;
+  for (int i = 0; i < HCI_STATS_MAX_OPCODES; i++) {
+    cmd_slot_t *c = &cmds[i];
+    if (c->s.opcode == opcode && (c->pending || c->s.count > 0))
+      return c;
+    if (!free_slot && !c->pending && c->s.count == 0)
+      free_slot = c;
+  }
+  if (!alloc)
+    return NULL;
+  if (!free_slot) {
+    cmds_untracked++;
+    return NULL;
+  }
+  free_slot->s.opcode = opcode;
+  return free_slot;
+}
+
+static void __not_in_flash_func(cmd_log_drain)(void) {
+  while (cmd_log_tail != cmd_log_head) {
+    ROLE_BARRIER();
+    const cmd_log_entry_t *e = &cmd_log[cmd_log_tail & (CMD_LOG_SIZE - 1)];
+    cmd_slot_t *c = cmd_slot(e->opcode, true);
+    if (c) {
+      c->pending = true;
+      c->issue_us = e->us;
+    }
+    ROLE_BARRIER();
+    cmd_log_tail++;
+  }
+}
+
+static void __not_in_flash_func(cmd_done)(uint16_t opcode) {
+  cmd_log_drain();
+  cmd_slot_t *c = cmd_slot(opcode, false);
+  if (!c || !c->pending)
+    return;
+  uint32_t us = time_us_32() - c->issue_us;
+  c->pending = false;
+  if (c->s.count == 0 || us < c->s.min_us)
+    c->s.min_us = us;
+  if (us > c->s.max_us)
+    c->s.max_us = us;
+  c->s.sum_us += us;
+  c->s.count++;
+}
+
+static void conn_open(uint16_t handle) {
+  conn_slot_t *c = find_conn(handle);
+  if (!c)
+    c = find_conn(NO_HANDLE);
+  if (!c)
+    return;
+  clear_counts(&c->s.rx);
+  clear_residency(&c->s.tx);
+  c->s.handle = handle; // Kept after disconnect for the report
+  c->c1_reset_req = true;
+  ROLE_BARRIER();
+  c->handle = handle;
+}
+
+static void __not_in_flash_func(rx_event)(const uint8_t *packet,
+                                          uint16_t size) {
+  switch (packet[0]) {
+  case HCI_EVT_CMD_COMPLETE:
+    if (size >= 5 && rd16(&packet[3]) != 0) // 0x0000: credits only
+      cmd_done(rd16(&packet[3]));
+    break;
+  case HCI_EVT_CMD_STATUS:
+    if (size >= 6 && rd16(&packet[4]) != 0)
+      cmd_done(rd16(&packet[4]));
+    break;
+  case HCI_EVT_CONN_COMPLETE:
+    if (size >= 5 && packet[2] == 0)
+      conn_open(rd16(&packet[3]) & 0x0FFF);
+    break;
+  case HCI_EVT_LE_META:
+    if (size >= 6 && (packet[2] == HCI_SUBEVT_LE_CONN_COMPLETE ||
+                      packet[2] == HCI_SUBEVT_LE_ENH_CONN_COMPLETE) &&
+        packet[3] == 0)
+      conn_open(rd16(&packet[4]) & 0x0FFF);
+    break;
+  case HCI_EVT_DISCONN_COMPLETE:
+    if (size >= 5 && packet[2] == 0) {
+      conn_slot_t *c = find_conn(rd16(&packet[3]) & 0x0FFF);
+      if (c)
+        c->handle = NO_HANDLE;
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+void __not_in_flash_func(hci_stats_rx)(uint8_t packet_type,
+                                       const uint8_t *packet, uint16_t size,
+                                       bool queued) {
+  if (reset_req) {
+    reset_req = false;
+    // Clear first: the HCI Reset that requested this is still in the log,
+    // and its completion must find it pending
+    for (int i = 0; i < HCI_STATS_MAX_OPCODES; i++)
+      cmds[i].pending = false;
+    cmd_log_drain();
+    for (int i = 0; i < HCI_STATS_MAX_CONNS; i++)
+      conns[i].handle = NO_HANDLE;
+  }
+
+  if (packet_type == HCI_EVENT_PACKET && size >= 2) {
+    rx_event(packet, size);
+    return;
+  }
+  if (packet_type != HCI_ACL_DATA_PACKET || size < 4)
+    return;
+  conn_slot_t *c = find_conn(rd16(packet) & 0x0FFF);
+  if (!c)
+    return;
+  if (queued) {
+    c->s.rx.pkts++;
+    c->s.rx.bytes += size;
+  } else {
+    c->s.rx.drops++;
+  }
+}
+
+void __not_in_flash_func(hci_stats_tx_sent)(const hci_packet_entry_t *entry) {
+  if (entry->packet_type != HCI_ACL_DATA_PACKET || entry->size < 4)
+    return;
+  conn_slot_t *c = find_conn(rd16(entry->data) & 0x0FFF);
+  if (c)
+    residency(&c->s.tx, entry->enq_us);
+}
+
+void hci_stats_get_and_reset(hci_stats_t *out) {
+  // hci_packet_handler runs from an IRQ on this core
+  uint32_t flags = save_and_disable_interrupts();
+
+  cmd_log_drain();
+  for (int i = 0; i < HCI_STATS_MAX_OPCODES; i++) {
+    out->cmds[i] = cmds[i].s;
+    cmds[i].s.count = 0;
+    cmds[i].s.min_us = 0;
+    cmds[i].s.max_us = 0;
+    cmds[i].s.sum_us = 0;
+  }
+  uint32_t overflow = cmd_log_overflow;
+  out->cmds_untracked = cmds_untracked + (overflow - cmd_log_overflow_seen);
+  cmds_untracked = 0;
+  cmd_log_overflow_seen = overflow;
+
+  for (int i = 0; i < HCI_STATS_MAX_CONNS; i++) {
+    conn_slot_t *c = &conns[i];
+    hci_conn_stats_t *o = &out->conns[i];
+    *o = c->s;
+    if (c->c1_reset_req) { // Core 1 has not cleared its counters yet
+      clear_counts(&o->tx);
+      clear_residency(&o->rx);
+    }
+    clear_counts(&c->s.rx);
+    clear_residency(&c->s.tx);
+    c->c1_reset_req = true;
+  }
+
+  restore_interrupts(flags);
+}
@@ -0,0 +1,68 @@
+// hci_stats.h - HCI command latency and per-connection accounting
+// Commands: Core 1 logs each host opcode with its arrival time; Core 0
+// matches it with the first Command Complete / Command Status for that
+// opcode and keeps min/avg/max latency per opcode.
+// Connections: ACL handles are learned from connection events (Core 0).
+// Each direction counts packets, bytes and drops on its producer core and
+// queue residency (enqueue -> handed to USB / CYW43) on its consumer core.
+#ifndef HCI_STATS_H
+#define HCI_STATS_H
+
+#include "hci_packet_queue.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define HCI_STATS_MAX_OPCODES 16
+#define HCI_STATS_MAX_CONNS 8
+
+typedef struct {
+  uint16_t opcode;
+  uint32_t count;
+  uint32_t min_us;
+  uint32_t max_us;
+  uint32_t sum_us;
+} hci_cmd_stats_t;
+
+typedef struct {
+  uint32_t pkts;
+  uint32_t bytes;
+  uint32_t drops;
+  uint32_t res_max_us; // Queue residency
+  uint32_t res_sum_us;
+  uint32_t res_n;
+} hci_conn_dir_stats_t;
+
+typedef struct {
+  uint16_t handle;
+  hci_conn_dir_stats_t rx; // Chip -> USB
+  hci_conn_dir_stats_t tx; // USB -> Chip
+} hci_conn_stats_t;
+
+typedef struct {
+  hci_cmd_stats_t cmds[HCI_STATS_MAX_OPCODES]; // count == 0: unused
+  uint32_t cmds_untracked; // Opcode table or issue log full
+  hci_conn_stats_t conns[HCI_STATS_MAX_CONNS]; // handle 0xFFFF: unused
+} hci_stats_t;
+
+void hci_stats_init(void);
+
+// Clear command and connection state (HCI Reset from host). Applied on
+// Core 0.
+void hci_stats_reset(void);
+
+// Core 1: host command forwarded / host ACL packet enqueued (or dropped)
+void hci_stats_cmd_issued(uint16_t opcode);
+void hci_stats_acl_tx(const uint8_t *packet, uint16_t size, bool queued);
+
+// Core 0: controller packet after the RX enqueue attempt
+void hci_stats_rx(uint8_t packet_type, const uint8_t *packet, uint16_t size,
+                  bool queued);
+
+// Queue residency when an entry leaves its queue (consumer core)
+void hci_stats_rx_sent(const hci_packet_entry_t *entry); // Core 1
+void hci_stats_tx_sent(const hci_packet_entry_t *entry); // Core 0
+
+// Windowed snapshot (Core 0)
+void hci_stats_get_and_reset(hci_stats_t *out);
+
+#endif // HCI_STATS_H
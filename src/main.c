@@ -1,53 +1,288 @@
 // main.c - Pico W Bluetooth Dongle Entry Point
-// Handles system init, Core 0/1 main loops
+// Handles system init and the per-core main loops (roles per topology.h)
 
+#include "acl_frag.h"
+#include "adv_filter.h"
 #include "bsp/board.h"
+#include "bt_a2dp.h"
 #include "bt_hci.h"
+#include "bt_sco.h"
 #include "btstack.h" // For HCI packet types
+#include "bus_sched.h"
 #include "hardware/clocks.h"
 #include "hardware/irq.h"
 #include "hardware/timer.h"
 #include "hci_packet_queue.h"
+#include "hci_stats.h"
 #include "pico/btstack_hci_transport_cyw43.h"
 #include "pico/cyw43_arch.h"
 #include "pico/multicore.h"
 #include "pico/stdlib.h"
 #include "stats.h"
+#include "topology.h"
+#include "trace.h"
 #include "tusb.h"
+#include "vendor_cmd.h"
+
+// System clock: RP2350 runs at 240MHz; RP2040 at 200MHz (the SDK's
+// supported maximum, with flash XIP still within spec)
+#ifndef DONGLE_SYS_CLOCK_KHZ
+#if PICO_RP2040
+#define DONGLE_SYS_CLOCK_KHZ 200000
+#else
+#define DONGLE_SYS_CLOCK_KHZ 240000
+#endif
+#endif
 
 // HCI transport handle
 static const hci_transport_t *transport;
 
-// --- Core 1: USB Manager ---
-void __not_in_flash_func(core1_entry)(void) {
-  while (1) {
-    stats_increment_core1_loops();
-    tud_task();
-
-    // Process RX queue (CYW43 -> USB)
-    hci_packet_entry_t *rx_pkt = hci_rx_peek();
-    if (rx_pkt) {
-      bool sent = false;
-      while (!sent) {
-        if (!tud_mounted()) {
-          sent = true;
-          break;
-        }
-        if (rx_pkt->packet_type == HCI_ACL_DATA_PACKET) {
-          if (tud_bt_acl_data_send(rx_pkt->data, rx_pkt->size))
-            sent = true;
-        } else if (rx_pkt->packet_type == HCI_EVENT_PACKET) {
-          if (tud_bt_event_send(rx_pkt->data, rx_pkt->size))
-            sent = true;
-        }
-        if (!sent)
-          tud_task();
-      }
-      hci_rx_free();
+// ACL packet boundary flag of continuation fragments
+#define ACL_PB_CONTINUATION 0x01
+
+// Max TX packets written per CYW43 bus session
+#define TX_BATCH_MAX 4
+static volatile uint8_t tx_batch_max = TX_BATCH_MAX;
+
+void tx_set_batch_max(uint8_t n) { tx_batch_max = n; }
+uint8_t tx_get_batch_max(void) { return tx_batch_max; }
+
+// --- CYW43 side: TX (USB -> CYW43) ---
+// Host ACL packet being sent in controller-sized fragments
+static hci_packet_entry_t *frag_pkt = NULL;
+static bool frag_prio = false;
+static uint16_t frag_off = 0; // Payload bytes already sent
+static uint16_t frag_mtu = 0; // Kept for the whole packet (HCI Reset)
+
+// Sends an entry, or its next fragment when it is an ACL packet above the
+// controller MTU (see acl_frag.h). A fragment's header is written in place
+// over the last bytes of the payload already sent, and the transport's
+// 4-byte pre-buffer lands before that, so nothing is copied. Sets *done
+// once the whole entry has been sent.
+static int __not_in_flash_func(tx_send)(hci_packet_entry_t *pkt, bool *done) {
+  uint16_t mtu = frag_off ? frag_mtu : 0;
+  if (!frag_off && pkt->packet_type == HCI_ACL_DATA_PACKET && pkt->size >= 4)
+    mtu = acl_frag_mtu();
+  uint16_t payload = pkt->size >= 4 ? pkt->size - 4 : 0;
+
+  if (mtu == 0 || payload <= mtu) {
+    *done = true;
+    int result =
+        transport->send_packet(pkt->packet_type, pkt->data, pkt->size);
+    if (result == 0 && pkt->packet_type == HCI_ACL_DATA_PACKET)
+      acl_frag_tx_begin(pkt, 1);
+    return result;
+  }
+
+  uint16_t len = payload - frag_off < mtu ? payload - frag_off : mtu;
+  uint8_t *frag = &pkt->data[frag_off];
+  if (frag_off > 0) {
+    frag[0] = pkt->data[0];
+    frag[1] = (pkt->data[1] & 0xCF) | (ACL_PB_CONTINUATION << 4);
+  }
+  frag[2] = len & 0xFF;
+  frag[3] = len >> 8;
+
+  *done = false;
+  int result = transport->send_packet(HCI_ACL_DATA_PACKET, frag, 4 + len);
+  if (result != 0)
+    return result;
+  if (frag_off == 0) {
+    frag_mtu = mtu;
+    acl_frag_tx_begin(pkt, (payload + mtu - 1) / mtu);
+  }
+  frag_off += len;
+  if (frag_off >= payload) {
+    // Restore the host header for the stats that look at the entry
+    pkt->data[2] = payload & 0xFF;
+    pkt->data[3] = payload >> 8;
+    frag_off = 0;
+    *done = true;
+  }
+  return 0;
+}
+
+// Drains up to tx_batch_max ready packets (A2DP media link first when due)
+// with the CYW43 lock held across the batch: one bus session, no background
+// bus polling interleaved between packets. A fragmented packet is finished
+// before the next one is picked; each fragment counts toward the batch.
+static void __not_in_flash_func(tx_process)(void) {
+  bool tx_prio = frag_prio;
+  hci_packet_entry_t *tx_pkt = frag_pkt ? frag_pkt : bt_a2dp_tx_next(&tx_prio);
+  if (!tx_pkt)
+    return;
+
+  uint32_t batch_pkts = 0;
+  uint32_t batch_bytes = 0;
+  bool busy = false;
+
+  uint64_t start = time_us_64();
+  stats_loop_phase(LOOP_PHASE_SEND_PACKET);
+  cyw43_thread_enter();
+  while (tx_pkt) {
+    bool done;
+    TRACE(TRACE_EV_SEND_BEGIN, tx_pkt->size);
+    int result = tx_send(tx_pkt, &done);
+    TRACE(TRACE_EV_SEND_END, result);
+    if (result != 0) {
+      busy = true;
+      break;
     }
+
+    batch_pkts++;
+    if (!done) {
+      frag_pkt = tx_pkt;
+      frag_prio = tx_prio;
+      if (batch_pkts >= tx_batch_max)
+        break;
+      continue;
+    }
+    frag_pkt = NULL;
+    stats_record_tx_send(); // Debug: record TX timing
+    hci_stats_tx_sent(tx_pkt);
+    batch_bytes += tx_pkt->size;
+    bt_a2dp_tx_free(tx_pkt, tx_prio);
+    if (batch_pkts >= tx_batch_max)
+      break;
+    tx_pkt = bt_a2dp_tx_next(&tx_prio);
+  }
+  cyw43_thread_exit();
+  stats_loop_phase(LOOP_PHASE_OTHER);
+  uint32_t dur = (uint32_t)(time_us_64() - start);
+
+  stats_update_spi_latency(dur);
+  // A session refused on its first packet is counted by hci_tx_signal_busy
+  if (batch_pkts > 0)
+    stats_record_tx_batch(batch_pkts, batch_bytes, dur);
+
+  if (busy) {
+    hci_tx_signal_busy();
+    busy_wait_us(50);
   }
 }
 
+// --- CYW43 side: init and loop iteration ---
+static bool cyw43_side_init(void) {
+  // The CYW43 driver's IRQs are bound to the core that initializes it
+  if (cyw43_arch_init_with_country(CYW43_COUNTRY_WORLDWIDE)) {
+    printf("CYW43 init failed\n");
+    return false;
+  }
+  cyw43_arch_disable_sta_mode();
+
+  // Boost bus IRQ priorities (NVIC is per core) for low-latency
+  irq_set_priority(DMA_IRQ_0, 0x40);
+  irq_set_priority(DMA_IRQ_1, 0x40);
+  irq_set_priority(PIO1_IRQ_0, 0x40);
+
+  transport = hci_transport_cyw43_instance();
+  transport->init(NULL);
+  transport->register_packet_handler(&hci_packet_handler);
+  transport->open();
+  bt_sco_init();
+  return true;
+}
+
+static void __not_in_flash_func(cyw43_side_iteration)(void) {
+  stats_loop_phase(LOOP_PHASE_STATS_TASK);
+  stats_task();
+  trace_task();
+  stats_loop_phase(LOOP_PHASE_OTHER);
+
+  // Forward coalesced advertising reports once their window expires
+  if (adv_filter_flush_due()) {
+    cyw43_thread_enter();
+    if (adv_filter_flush_due())
+      adv_filter_flush();
+    cyw43_thread_exit();
+  }
+
+  // Dongle vendor commands from the host
+  vendor_cmd_task();
+
+  // Host voice packets (ISO OUT) ahead of bulk TX
+  bt_sco_task();
+
+  // Process TX queues (USB -> CYW43)
+  tx_process();
+
+  // LED and other housekeeping bus writes, in idle gaps only
+  bus_sched_task();
+}
+
+// --- USB side: TinyUSB, RX drain (CYW43 -> USB) ---
+// With a core of its own the USB side waits for the endpoint to take the
+// head packet; sharing the core, it retries on the next pass instead so
+// the CYW43 side keeps running.
+static void __not_in_flash_func(rx_process)(void) {
+  hci_packet_entry_t *rx_pkt = hci_rx_peek();
+  if (!rx_pkt)
+    return;
+
+  stats_loop_phase(LOOP_PHASE_USB_SEND_WAIT);
+  bool sent = false;
+  while (!sent) {
+    if (!tud_mounted()) {
+      sent = true;
+      break;
+    }
+    if (rx_pkt->packet_type == HCI_ACL_DATA_PACKET) {
+      if (tud_bt_acl_data_send(rx_pkt->data, rx_pkt->size))
+        sent = true;
+    } else if (rx_pkt->packet_type == HCI_EVENT_PACKET) {
+      if (tud_bt_event_send(rx_pkt->data, rx_pkt->size))
+        sent = true;
+    }
+    if (sent) {
+      TRACE(TRACE_EV_USB_SEND, rx_pkt->size);
+      hci_stats_rx_sent(rx_pkt);
+    } else if (USB_CORE == CYW43_CORE) {
+      break;
+    } else {
+      TRACE(TRACE_EV_TUD_TASK_BEGIN, 1);
+      tud_task();
+      TRACE(TRACE_EV_TUD_TASK_END, 1);
+    }
+  }
+  if (sent)
+    hci_rx_free();
+  stats_loop_phase(LOOP_PHASE_OTHER);
+}
+
+static void __not_in_flash_func(usb_side_iteration)(void) {
+  stats_loop_phase(LOOP_PHASE_TUD_TASK);
+  TRACE(TRACE_EV_TUD_TASK_BEGIN, 0);
+  tud_task();
+  TRACE(TRACE_EV_TUD_TASK_END, 0);
+  stats_loop_phase(LOOP_PHASE_OTHER);
+
+  rx_process();
+}
+
+// --- Per-core loops: each core runs the roles topology.h assigns to it ---
+static void __not_in_flash_func(core_loop)(uint core) {
+  while (1) {
+    if (core == 0)
+      stats_increment_core0_loops();
+    else
+      stats_increment_core1_loops();
+    if (core == CYW43_CORE)
+      cyw43_side_iteration();
+    if (core == USB_CORE)
+      usb_side_iteration();
+  }
+}
+
+void __not_in_flash_func(core1_entry)(void) {
+#if CYW43_CORE == 1
+  bool ok = cyw43_side_init();
+  multicore_fifo_push_blocking(ok);
+  if (!ok)
+    return;
+#endif
+  core_loop(1);
+}
+
 // --- USB Callbacks ---
 void tud_mount_cb(void) { printf("USB MOUNTED\n"); }
 void tud_umount_cb(void) { printf("USB UNMOUNTED\n"); }
@@ -61,62 +296,47 @@ void tud_resume_cb(void) { printf("USB RESUMED\n"); }
 int main(void) {
   // 1. Init queue before anything else
   hci_packet_queue_init();
+  acl_frag_init();
+  adv_filter_init();
+  bt_a2dp_init();
+  hci_stats_init();
+  bus_sched_init();
   stats_init();
 
   // 2. System init
-  set_sys_clock_khz(240000, true);
+  set_sys_clock_khz(DONGLE_SYS_CLOCK_KHZ, true);
   board_init();
   stdio_init_all();
   printf("Pico W Bluetooth Dongle v2.1 (debug)\n");
+  vendor_cmd_init();
 
-  // 3. CYW43 init
-  if (cyw43_arch_init_with_country(CYW43_COUNTRY_WORLDWIDE)) {
-    printf("CYW43 init failed\n");
+  printf("Core topology: %s (CYW43 on Core %u, USB on Core %u)\n",
+         DONGLE_TOPOLOGY_NAME, CYW43_CORE, USB_CORE);
+
+  // 3. CYW43 side init (on Core 1 in the SWAPPED topology, see below)
+#if CYW43_CORE == 0
+  if (!cyw43_side_init())
     return -1;
-  }
-  cyw43_arch_disable_sta_mode();
+#endif
 
-  // 4. Boost IRQ priorities for low-latency
-  irq_set_priority(DMA_IRQ_0, 0x40);
-  irq_set_priority(DMA_IRQ_1, 0x40);
-  irq_set_priority(PIO1_IRQ_0, 0x40);
+  // 4. Init USB, with its IRQ boosted for low-latency
   irq_set_priority(USBCTRL_IRQ, 0x40);
-
-  // 5. Init HCI transport
-  transport = hci_transport_cyw43_instance();
-  transport->init(NULL);
-  transport->register_packet_handler(&hci_packet_handler);
-  transport->open();
-
-  // 6. Init USB
   tusb_init();
 
-  // 7. Launch Core 1
+#if DONGLE_QUEUE_BENCH
+  hci_packet_queue_bench();
+#endif
+
+  // 5. Launch Core 1 unless everything runs on Core 0
+#if CYW43_CORE == 1
   multicore_launch_core1(core1_entry);
+  if (!multicore_fifo_pop_blocking())
+    return -1;
+#elif USB_CORE == 1
+  multicore_launch_core1(core1_entry);
+#endif
   printf("Entering main loop\n");
 
-  // 8. Core 0 loop: TX processing + stats
-  while (1) {
-    stats_increment_core0_loops();
-    stats_task();
-
-    // Process TX queue (USB -> CYW43)
-    hci_packet_entry_t *tx_pkt = hci_tx_peek();
-    if (tx_pkt) {
-      uint64_t start = time_us_64();
-      int result = transport->send_packet(tx_pkt->packet_type, tx_pkt->data,
-                                          tx_pkt->size);
-      uint32_t dur = (uint32_t)(time_us_64() - start);
-
-      stats_update_spi_latency(dur);
-      stats_record_tx_send(); // Debug: record TX timing
-
-      if (result == 0) {
-        hci_tx_free();
-      } else {
-        hci_tx_signal_busy();
-        busy_wait_us(50);
-      }
-    }
-  }
+  // 6. Core 0 loop
+  core_loop(0);
 }
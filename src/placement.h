@@ -0,0 +1,40 @@
+// placement.h - SRAM bank placement of per-core hot data
+// Core 0's stack lives in SCRATCH_Y (SRAM9 on RP2350, SRAM5 on RP2040) and
+// Core 1's stack in SCRATCH_X (SRAM8 / SRAM4). With DONGLE_SRAM_PLACEMENT,
+// small data written only by the owning core is placed in that core's
+// scratch bank, off the striped main SRAM the queues and DMA use. The other
+// core still reads some of it (e.g. the queue heads on every peek), so
+// those reads cross to the owner's bank. Each scratch bank is 4KB, half of
+// it stack: keep placed objects small (indices, counters) - large buffers
+// stay striped.
+// Data owned by a forwarding role (see topology.h) uses CYW43_CORE_DATA /
+// USB_CORE_DATA so it follows that role to whichever core runs it.
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include "pico.h"
+#include "topology.h"
+
+#ifndef DONGLE_SRAM_PLACEMENT
+#define DONGLE_SRAM_PLACEMENT 0
+#endif
+
+#if DONGLE_SRAM_PLACEMENT
+#define CORE0_DATA(group) __scratch_y(group)
+#define CORE1_DATA(group) __scratch_x(group)
+#else
+#define CORE0_DATA(group)
+#define CORE1_DATA(group)
+#endif
+
+// With a single core the USB side keeps Core 1's idle bank, so the 2KB left
+// beside Core 0's stack is not shared by both roles
+#if CYW43_CORE == 1
+#define CYW43_CORE_DATA(group) CORE1_DATA(group)
+#define USB_CORE_DATA(group) CORE0_DATA(group)
+#else
+#define CYW43_CORE_DATA(group) CORE0_DATA(group)
+#define USB_CORE_DATA(group) CORE1_DATA(group)
+#endif
+
+#endif // PLACEMENT_H
@@ -0,0 +1,129 @@
+// sco_codec.c - On-dongle mSBC codec for wideband speech (Core 1)
+// Wraps BTstack's SBC codec (mSBC mode). Each call is timed with the
+// calling core's SysTick, so the per-frame cost can be compared against
+// the 7.5 ms frame budget.
+#include "sco_codec.h"
+
+#if DONGLE_SCO_TRANSCODE
+
+#include "btstack_sbc.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+#include "pico.h"
+#include <string.h>
+
+#define MSBC_H2_SYNC 0x01
+#define MSBC_SBC_FRAME_LEN 57
+#define MSBC_BITPOOL 26
+
+static btstack_sbc_decoder_state_t dec_state;
+static btstack_sbc_encoder_state_t enc_state;
+static int16_t *dec_out = NULL;
+static bool dec_got = false;
+static uint8_t h2_seq = 0;
+
+// Core 1
+static sco_codec_stats_t stats;
+static uint64_t dec_sum = 0;
+static uint64_t enc_sum = 0;
+static volatile bool reset_req = false;
+
+static const uint8_t h2_seq_byte[4] = {0x08, 0x38, 0xC8, 0xF8};
+
+static inline uint32_t cycles_now(void) { return systick_hw->cvr; }
+
+// SysTick counts down, 24 bits
+static inline uint32_t cycles_since(uint32_t start) {
+  return (start - systick_hw->cvr) & 0x00FFFFFF;
+}
+
+static void __not_in_flash_func(account)(sco_codec_op_stats_t *op,
+                                         uint64_t *sum, uint32_t cycles) {
+  if (reset_req) {
+    reset_req = false;
+    memset(&stats.dec, 0, sizeof(stats.dec));
+    memset(&stats.enc, 0, sizeof(stats.enc));
+    stats.bad_frames = 0;
+    dec_sum = enc_sum = 0;
+  }
+  op->frames++;
+  *sum += cycles;
+  if (cycles > op->max_cycles)
+    op->max_cycles = cycles;
+}
+
+static void handle_pcm(int16_t *data, int num_samples, int num_channels,
+                       int sample_rate, void *context) {
+  (void)num_channels;
+  (void)sample_rate;
+  (void)context;
+  if (num_samples != SCO_CODEC_FRAME_SAMPLES || !dec_out)
+    return;
+  memcpy(dec_out, data, SCO_CODEC_FRAME_SAMPLES * sizeof(int16_t));
+  dec_got = true;
+}
+
+void sco_codec_start(void) {
+  // SysTick is per core: configure it on the codec core
+  systick_hw->csr = 0;
+  systick_hw->rvr = 0x00FFFFFF;
+  systick_hw->cvr = 0;
+  systick_hw->csr = 0x5; // Enable, processor clock
+
+  btstack_sbc_decoder_init(&dec_state, SBC_MODE_mSBC, &handle_pcm, NULL);
+  btstack_sbc_encoder_init(&enc_state, SBC_MODE_mSBC, 16, 8,
+                           SBC_ALLOCATION_METHOD_LOUDNESS, 16000,
+                           MSBC_BITPOOL, SBC_CHANNEL_MODE_MONO);
+  h2_seq = 0;
+  reset_req = true;
+}
+
+bool __not_in_flash_func(sco_codec_decode)(
+    const uint8_t *payload, uint16_t len, uint8_t status,
+    int16_t pcm[SCO_CODEC_FRAME_SAMPLES]) {
+  dec_out = pcm;
+  dec_got = false;
+  uint32_t start = cycles_now();
+  btstack_sbc_decoder_process_data(&dec_state, status, payload, len);
+  account(&stats.dec, &dec_sum, cycles_since(start));
+  if (status != 0)
+    stats.bad_frames++;
+  dec_out = NULL;
+  return dec_got;
+}
+
+void __not_in_flash_func(sco_codec_encode)(
+    const int16_t pcm[SCO_CODEC_FRAME_SAMPLES],
+    uint8_t msbc[SCO_MSBC_FRAME_LEN]) {
+  uint32_t start = cycles_now();
+  btstack_sbc_encoder_process_data((int16_t *)pcm);
+  account(&stats.enc, &enc_sum, cycles_since(start));
+
+  // H2 synchronization header, SBC frame, one pad byte
+  msbc[0] = MSBC_H2_SYNC;
+  msbc[1] = h2_seq_byte[h2_seq++ & 3];
+  uint16_t n = btstack_sbc_encoder_sbc_buffer_length();
+  if (n > MSBC_SBC_FRAME_LEN)
+    n = MSBC_SBC_FRAME_LEN;
+  memset(&msbc[2], 0, SCO_MSBC_FRAME_LEN - 2);
+  memcpy(&msbc[2], btstack_sbc_encoder_sbc_buffer(), n);
+}
+
+void sco_codec_get_stats_and_reset(sco_codec_stats_t *stats_out) {
+  *stats_out = stats;
+  if (reset_req) { // Core 1 has not cleared the last window yet
+    memset(&stats_out->dec, 0, sizeof(stats_out->dec));
+    memset(&stats_out->enc, 0, sizeof(stats_out->enc));
+    stats_out->bad_frames = 0;
+  }
+  if (stats_out->dec.frames)
+    stats_out->dec.avg_cycles = (uint32_t)(dec_sum / stats_out->dec.frames);
+  if (stats_out->enc.frames)
+    stats_out->enc.avg_cycles = (uint32_t)(enc_sum / stats_out->enc.frames);
+  // From the current clock, so a runtime set_sys_clock_khz() is reflected
+  stats_out->budget_cycles =
+      clock_get_hz(clk_sys) / 1000 * SCO_CODEC_FRAME_US / 1000;
+  reset_req = true;
+}
+
+#endif // DONGLE_SCO_TRANSCODE
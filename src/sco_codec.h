@@ -0,0 +1,50 @@
+// sco_codec.h - On-dongle mSBC codec for wideband speech (Core 1)
+// With DONGLE_SCO_TRANSCODE the host exchanges 16 kHz 16-bit PCM over the
+// ISO endpoints (alt setting 3) and the dongle runs the mSBC codec: SCO
+// packets from the controller are decoded on their way to USB and host
+// PCM is encoded on its way to the controller. This only applies while the
+// host's voice setting selects transparent air coding; with CVSD air coding
+// the controller converts linear PCM itself and nothing is transcoded.
+#ifndef SCO_CODEC_H
+#define SCO_CODEC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef DONGLE_SCO_TRANSCODE
+#define DONGLE_SCO_TRANSCODE 0
+#endif
+
+#define SCO_CODEC_FRAME_SAMPLES 120 // 7.5 ms at 16 kHz
+#define SCO_CODEC_FRAME_US 7500
+#define SCO_MSBC_FRAME_LEN 60 // H2 header + 57-byte SBC frame + pad
+
+typedef struct {
+  uint32_t frames;
+  uint32_t avg_cycles;
+  uint32_t max_cycles;
+} sco_codec_op_stats_t;
+
+typedef struct {
+  sco_codec_op_stats_t dec;
+  sco_codec_op_stats_t enc;
+  uint32_t budget_cycles; // System clock cycles per 7.5 ms frame
+  uint32_t bad_frames;    // Decoder concealment (lost / corrupt frames)
+} sco_codec_stats_t;
+
+// Reset codec state for a new stream (Core 1)
+void sco_codec_start(void);
+
+// Feed one mSBC SCO payload. Returns true when a PCM frame was produced.
+// status = SCO Packet Status Flag (0 = correctly received).
+bool sco_codec_decode(const uint8_t *payload, uint16_t len, uint8_t status,
+                      int16_t pcm[SCO_CODEC_FRAME_SAMPLES]);
+
+// Encode one PCM frame into an H2-framed mSBC payload
+void sco_codec_encode(const int16_t pcm[SCO_CODEC_FRAME_SAMPLES],
+                      uint8_t msbc[SCO_MSBC_FRAME_LEN]);
+
+// Windowed cycle counts (read on Core 0, reset applied by Core 1)
+void sco_codec_get_stats_and_reset(sco_codec_stats_t *stats_out);
+
+#endif // SCO_CODEC_H
@@ -1,11 +1,22 @@
 // stats.c - Statistics and LED activity for Pico W Bluetooth Dongle
 #include "stats.h"
+#include "acl_frag.h"
+#include "adv_filter.h"
 #include "bsp/board.h"
+#include "bt_a2dp.h"
 #include "bt_hci.h"
+#include "bt_sco.h"
+#include "bus_sched.h"
 #include "hardware/timer.h"
 #include "hci_packet_queue.h"
+#include "hci_stats.h"
 #include "pico/cyw43_arch.h"
+#include "placement.h"
+#include "sco_codec.h"
+#include "topology.h"
+#include "trace.h"
 #include <stdio.h>
+#include <string.h>
 
 // --- Profiling Variables ---
 static volatile uint32_t prof_c0_loops = 0;
@@ -13,14 +24,77 @@ static volatile uint32_t prof_c1_loops = 0;
 static volatile uint32_t prof_spi_max_us = 0;
 static volatile uint32_t prof_spi_last_us = 0;
 
+// --- TX Batching (Core 0 only) ---
+static uint32_t batch_sessions = 0;
+static uint32_t batch_pkts = 0;
+static uint32_t batch_bytes = 0;
+static uint32_t batch_us = 0;
+
+// --- Loop Iteration Timing (Stall Detector) ---
+// Histogram buckets are log2(us): bucket b holds [2^(b-1), 2^b) us
+#define LOOP_HIST_BUCKETS 16
+#define LOOP_TOP_N 4
+// Iterations slower than this trigger a trace dump (0 = never)
+#ifndef LOOP_STALL_TRACE_US
+#define LOOP_STALL_TRACE_US 10000
+#endif
+
+typedef struct {
+  uint32_t us;
+  uint32_t at_ms;
+  uint8_t phase; // Phase the iteration spent longest in
+} loop_stall_t;
+
+typedef struct {
+  // Owned by the looping core
+  uint32_t iter_start_us;
+  uint32_t phase_start_us;
+  uint32_t worst_phase_us;
+  uint8_t phase;
+  uint8_t worst_phase;
+  uint32_t max_us;
+  uint32_t hist[LOOP_HIST_BUCKETS];
+  loop_stall_t top[LOOP_TOP_N];
+  // Set by the stats reporter, cleared by the owner at its next boundary
+  volatile bool reset_req;
+} loop_prof_t;
+
+static loop_prof_t CORE0_DATA("loop_prof") loop_prof_c0;
+static loop_prof_t CORE1_DATA("loop_prof") loop_prof_c1;
+static loop_prof_t *const loop_prof[NUM_CORES] = {&loop_prof_c0,
+                                                  &loop_prof_c1};
+
+static const char *const loop_phase_names[LOOP_PHASE_COUNT] = {
+    "other", "tud_task", "usb_wait", "send_pkt", "stats"};
+
 // --- TX Gap Timing (Debug) ---
+// Gaps above this freeze the trace rings and dump them (DONGLE_TRACE).
+// Gaps above TX_GAP_IDLE_US are idle periods, not stutter.
+#define TX_GAP_STUTTER_US 20000
+#define TX_GAP_IDLE_US 500000
+
 static volatile uint64_t last_tx_time = 0;
 static volatile uint32_t tx_gap_max_us = 0;
 static volatile uint32_t tx_gap_count = 0;
 static volatile uint64_t tx_gap_sum = 0;
 
+// --- A2DP Media TX Gap (Core 0 only) ---
+// 1 ms buckets; the last bucket collects everything >= 63 ms
+#define MEDIA_GAP_BUCKETS 64
+
+static uint32_t last_media_tx_us = 0;
+static uint32_t media_gap_hist[MEDIA_GAP_BUCKETS];
+static uint32_t media_gap_count = 0;
+static uint32_t media_gap_max_us = 0;
+
 // --- LED ---
 static bool led_state = false;
+static volatile uint8_t led_mode = STATS_LED_ACTIVITY;
+
+// --- Last Completed Report Window (Core 0 only) ---
+static uint32_t report[STATS_CTR_COUNT];
+static uint32_t report_loop_hist[NUM_CORES][LOOP_HIST_BUCKETS];
+static uint32_t report_media_hist[MEDIA_GAP_BUCKETS];
 
 void stats_init(void) {
   prof_c0_loops = 0;
@@ -32,29 +106,240 @@ void stats_init(void) {
   tx_gap_sum = 0;
 }
 
-void stats_update_spi_latency(uint32_t us) {
+void __not_in_flash_func(stats_update_spi_latency)(uint32_t us) {
   prof_spi_last_us = us;
   if (us > prof_spi_max_us)
     prof_spi_max_us = us;
 }
 
-void stats_increment_core0_loops(void) { prof_c0_loops++; }
-void stats_increment_core1_loops(void) { prof_c1_loops++; }
+void __not_in_flash_func(stats_record_tx_batch)(uint32_t pkts, uint32_t bytes,
+                                                uint32_t us) {
+  batch_sessions++;
+  batch_pkts += pkts;
+  batch_bytes += bytes;
+  batch_us += us;
+}
+
+static inline void __not_in_flash_func(loop_phase_close)(loop_prof_t *lp,
+                                                          uint32_t now) {
+  uint32_t elapsed = now - lp->phase_start_us;
+  if (elapsed > lp->worst_phase_us) {
+    lp->worst_phase_us = elapsed;
+    lp->worst_phase = lp->phase;
+  }
+  lp->phase_start_us = now;
+}
+
+static void __not_in_flash_func(loop_iteration_boundary)(loop_prof_t *lp) {
+  uint32_t now = time_us_32();
+
+  if (lp->reset_req) {
+    memset(lp->hist, 0, sizeof(lp->hist));
+    memset(lp->top, 0, sizeof(lp->top));
+    lp->max_us = 0;
+    lp->reset_req = false;
+  }
+
+  if (lp->iter_start_us != 0) {
+    loop_phase_close(lp, now);
+    uint32_t dur = now - lp->iter_start_us;
+
+    uint32_t b = dur ? 32 - __builtin_clz(dur) : 0;
+    if (b >= LOOP_HIST_BUCKETS)
+      b = LOOP_HIST_BUCKETS - 1;
+    lp->hist[b]++;
+    if (dur > lp->max_us)
+      lp->max_us = dur;
+
+    // Keep top-N sorted, slowest first
+    if (dur > lp->top[LOOP_TOP_N - 1].us) {
+      int i = LOOP_TOP_N - 1;
+      while (i > 0 && lp->top[i - 1].us < dur) {
+        lp->top[i] = lp->top[i - 1];
+        i--;
+      }
+      lp->top[i].us = dur;
+      lp->top[i].at_ms = board_millis();
+      lp->top[i].phase = lp->worst_phase;
+    }
+
+    // The stats report itself is a known long iteration; don't dump on it
+    if (LOOP_STALL_TRACE_US && dur > LOOP_STALL_TRACE_US &&
+        lp->worst_phase != LOOP_PHASE_STATS_TASK)
+      trace_trigger(dur);
+  }
+
+  lp->iter_start_us = now;
+  lp->phase_start_us = now;
+  lp->phase = LOOP_PHASE_OTHER;
+  lp->worst_phase = LOOP_PHASE_OTHER;
+  lp->worst_phase_us = 0;
+}
+
+void __not_in_flash_func(stats_increment_core0_loops)(void) {
+  prof_c0_loops++;
+  loop_iteration_boundary(&loop_prof_c0);
+}
+
+void __not_in_flash_func(stats_increment_core1_loops)(void) {
+  prof_c1_loops++;
+  loop_iteration_boundary(&loop_prof_c1);
+}
+
+void __not_in_flash_func(stats_loop_phase)(loop_phase_t phase) {
+  loop_prof_t *lp = loop_prof[get_core_num()];
+  loop_phase_close(lp, time_us_32());
+  lp->phase = phase;
+}
+
+static void print_loop_prof(unsigned core) {
+  loop_prof_t *lp = loop_prof[core];
+
+  memcpy(report_loop_hist[core], lp->hist, sizeof(lp->hist));
+  report[core ? STATS_CTR_C1_LOOP_MAX_US : STATS_CTR_C0_LOOP_MAX_US] =
+      lp->max_us;
+
+  printf("LOOP C%u    : Max=%lu us  Hist(us):", core,
+         (unsigned long)lp->max_us);
+  for (int b = 0; b < LOOP_HIST_BUCKETS; b++) {
+    if (lp->hist[b] == 0)
+      continue;
+    if (b == LOOP_HIST_BUCKETS - 1)
+      printf(" >=%lu:%lu", 1UL << (b - 1), (unsigned long)lp->hist[b]);
+    else
+      printf(" <%lu:%lu", 1UL << b, (unsigned long)lp->hist[b]);
+  }
+  printf("\n");
+
+  printf("STALLS C%u  :", core);
+  for (int i = 0; i < LOOP_TOP_N && lp->top[i].us; i++) {
+    printf(" %luus(%s@%lums)", (unsigned long)lp->top[i].us,
+           loop_phase_names[lp->top[i].phase],
+           (unsigned long)lp->top[i].at_ms);
+  }
+  printf("\n");
+
+  lp->reset_req = true;
+}
 
 // Debug: Record TX send event for gap timing
-void stats_record_tx_send(void) {
+void __not_in_flash_func(stats_record_tx_send)(void) {
   uint64_t now = time_us_64();
   if (last_tx_time > 0) {
     uint32_t gap = (uint32_t)(now - last_tx_time);
     if (gap > tx_gap_max_us)
       tx_gap_max_us = gap;
+    if (gap > TX_GAP_STUTTER_US && gap < TX_GAP_IDLE_US)
+      trace_trigger(gap);
     tx_gap_sum += gap;
     tx_gap_count++;
   }
   last_tx_time = now;
 }
 
-void stats_task(void) {
+void __not_in_flash_func(stats_record_media_tx_send)(void) {
+  uint32_t now = time_us_32();
+  uint32_t gap = now - last_media_tx_us;
+  last_media_tx_us = now;
+  if (gap >= TX_GAP_IDLE_US)
+    return; // Stream (re)start
+  uint32_t b = gap / 1000;
+  media_gap_hist[b < MEDIA_GAP_BUCKETS ? b : MEDIA_GAP_BUCKETS - 1]++;
+  media_gap_count++;
+  if (gap > media_gap_max_us)
+    media_gap_max_us = gap;
+}
+
+// One direction of a connection's traffic, appended to its CONN line
+static void print_conn_dir(const char *name, const hci_conn_dir_stats_t *d) {
+  printf("  %s=%lu pkts %lu.%02lu KB/s Drop=%lu Res=%lu/%lu us", name,
+         (unsigned long)d->pkts, (unsigned long)(d->bytes / 10240),
+         (unsigned long)((d->bytes % 10240) * 100 / 10240),
+         (unsigned long)d->drops,
+         (unsigned long)(d->res_n ? d->res_sum_us / d->res_n : 0),
+         (unsigned long)d->res_max_us);
+}
+
+// Per-opcode command latency and per-connection traffic for the window
+static void print_hci_stats(void) {
+  static hci_stats_t hs; // Too large for the Core 0 stack
+  hci_stats_get_and_reset(&hs);
+
+  for (int i = 0; i < HCI_STATS_MAX_OPCODES; i++) {
+    const hci_cmd_stats_t *c = &hs.cmds[i];
+    if (c->count == 0)
+      continue;
+    printf("CMD 0x%04X : N=%lu  Min=%lu Avg=%lu Max=%lu us\n", c->opcode,
+           (unsigned long)c->count, (unsigned long)c->min_us,
+           (unsigned long)(c->sum_us / c->count), (unsigned long)c->max_us);
+  }
+  if (hs.cmds_untracked > 0)
+    printf("CMD ----   : Untracked=%lu\n", (unsigned long)hs.cmds_untracked);
+
+  for (int i = 0; i < HCI_STATS_MAX_CONNS; i++) {
+    const hci_conn_stats_t *c = &hs.conns[i];
+    if (c->rx.pkts + c->rx.drops + c->tx.pkts + c->tx.drops == 0)
+      continue;
+    printf("CONN 0x%03X :", c->handle);
+    print_conn_dir("RX", &c->rx);
+    print_conn_dir("TX", &c->tx);
+    printf("\n");
+  }
+}
+
+// Upper bound (ms) of the bucket holding the given percentile
+static uint32_t media_gap_percentile_ms(uint32_t pct) {
+  uint32_t target = (media_gap_count * pct + 99) / 100;
+  uint32_t acc = 0;
+  for (uint32_t b = 0; b < MEDIA_GAP_BUCKETS; b++) {
+    acc += media_gap_hist[b];
+    if (acc >= target)
+      return b + 1;
+  }
+  return MEDIA_GAP_BUCKETS;
+}
+
+void stats_set_led_mode(stats_led_mode_t mode) {
+  if (mode < STATS_LED_MODE_COUNT)
+    led_mode = mode;
+}
+
+stats_led_mode_t stats_get_led_mode(void) {
+  return (stats_led_mode_t)led_mode;
+}
+
+uint32_t stats_get_counter(stats_counter_t id) {
+  return id < STATS_CTR_COUNT ? report[id] : 0;
+}
+
+uint8_t stats_get_histogram(stats_hist_t id, uint8_t first, uint32_t *out,
+                            uint8_t max, uint8_t *total) {
+  const uint32_t *hist;
+  uint8_t n;
+  switch (id) {
+  case STATS_HIST_LOOP_C0:
+  case STATS_HIST_LOOP_C1:
+    hist = report_loop_hist[id - STATS_HIST_LOOP_C0];
+    n = LOOP_HIST_BUCKETS;
+    break;
+  case STATS_HIST_MEDIA_GAP:
+    hist = report_media_hist;
+    n = MEDIA_GAP_BUCKETS;
+    break;
+  default:
+    *total = 0;
+    return 0;
+  }
+  *total = n;
+  if (first >= n)
+    return 0;
+  if (max > n - first)
+    max = n - first;
+  memcpy(out, &hist[first], max * sizeof(uint32_t));
+  return max;
+}
+
+void __not_in_flash_func(stats_task)(void) {
   static uint32_t last_stats = 0;
   static uint32_t last_led = 0;
   static uint32_t led_bytes_snapshot = 0;
@@ -78,20 +363,26 @@ void stats_task(void) {
 
   if (now - last_led >= led_interval) {
     last_led = now;
-    led_state = !led_state;
-    cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, led_state);
+    bool next = led_mode == STATS_LED_ACTIVITY ? !led_state
+                                               : led_mode == STATS_LED_ON;
+    if (next != led_state) {
+      led_state = next;
+      bus_sched_gpio_put(CYW43_WL_GPIO_LED_PIN, led_state);
+    }
     led_bytes_snapshot = tx_bytes; // Snapshot for next interval
   }
 
   // --- Stats Printing (every 10s) ---
   if (now - last_stats >= 10000) {
+    report[STATS_CTR_WINDOW_MS] = now - last_stats;
     last_stats = now;
+    TRACE(TRACE_EV_STATS_BEGIN, 0);
 
     queue_stats_t s;
     hci_packet_queue_get_stats_and_reset(&s);
 
     float rx_kbps = (float)s.rx.bytes / 10240.0f;
-    float tx_kbps = (float)s.tx.bytes / 10240.0f;
+    float tx_kbps = (float)(s.tx.bytes + s.tx_prio.bytes) / 10240.0f;
 
     // Calculate average TX gap
     uint32_t tx_gap_avg =
@@ -100,32 +391,202 @@ void stats_task(void) {
     printf("\n=== SYSTEM HEALTH (10s) ===\n");
     printf("THROUGHPUT : RX=%.2f KB/s (%lu pkts)  TX=%.2f KB/s (%lu pkts)\n",
            rx_kbps, (unsigned long)s.rx.total, tx_kbps,
-           (unsigned long)s.tx.total);
-    printf("QUEUES     : RX_Peak=%lu  TX_Peak=%lu  Drops=%lu\n",
+           (unsigned long)(s.tx.total + s.tx_prio.total));
+    printf("QUEUES     : RX_Peak=%lu  TX_Peak=%lu  TXM_Peak=%lu  "
+           "Drops=%lu\n",
            (unsigned long)s.rx.peak_depth, (unsigned long)s.tx.peak_depth,
-           (unsigned long)(s.rx.drops + s.tx.drops));
+           (unsigned long)s.tx_prio.peak_depth,
+           (unsigned long)(s.rx.drops + s.tx.drops + s.tx_prio.drops));
+    if (s.rx.drops + s.tx.drops + s.tx_prio.drops > 0) {
+      uint8_t res_crit, res_acl;
+      hci_packet_queue_get_reserves(&res_crit, &res_acl);
+      printf("DROPS      : RX Crit=%lu ACL=%lu Disc=%lu  "
+             "TX Crit=%lu ACL=%lu Disc=%lu  (reserve %u/%u)\n",
+             (unsigned long)s.rx.class_drops[HCI_CLASS_CRITICAL],
+             (unsigned long)s.rx.class_drops[HCI_CLASS_ACL],
+             (unsigned long)s.rx.class_drops[HCI_CLASS_DISCARDABLE],
+             (unsigned long)s.tx.class_drops[HCI_CLASS_CRITICAL],
+             (unsigned long)(s.tx.class_drops[HCI_CLASS_ACL] +
+                             s.tx_prio.class_drops[HCI_CLASS_ACL]),
+             (unsigned long)s.tx.class_drops[HCI_CLASS_DISCARDABLE], res_crit,
+             res_acl);
+    }
     printf("TX BUSY    : %lu (CYW43 buffer full retries)\n",
            (unsigned long)s.tx.driver_busy);
-    printf("CPU LOOP   : Core0=%lu k/s  Core1=%lu k/s\n",
+    report[STATS_CTR_RX_PKTS] = s.rx.total;
+    report[STATS_CTR_RX_BYTES] = s.rx.bytes;
+    report[STATS_CTR_TX_PKTS] = s.tx.total + s.tx_prio.total;
+    report[STATS_CTR_TX_BYTES] = s.tx.bytes + s.tx_prio.bytes;
+    report[STATS_CTR_RX_DROPS] = s.rx.drops;
+    report[STATS_CTR_TX_DROPS] = s.tx.drops + s.tx_prio.drops;
+    report[STATS_CTR_RX_PEAK] = s.rx.peak_depth;
+    report[STATS_CTR_TX_PEAK] = s.tx.peak_depth;
+    report[STATS_CTR_TXM_PEAK] = s.tx_prio.peak_depth;
+    report[STATS_CTR_TX_BUSY] = s.tx.driver_busy;
+    report[STATS_CTR_C0_LOOPS] = prof_c0_loops;
+    report[STATS_CTR_C1_LOOPS] = prof_c1_loops;
+    printf("CPU LOOP   : Core0=%lu k/s  Core1=%lu k/s  (%s: CYW43 C%u, "
+           "USB C%u)\n",
            (unsigned long)(prof_c0_loops / 10000),
-           (unsigned long)(prof_c1_loops / 10000));
-    printf("SPI LAT    : Max=%lu us  Last=%lu us\n",
+           (unsigned long)(prof_c1_loops / 10000), DONGLE_TOPOLOGY_NAME,
+           CYW43_CORE, USB_CORE);
+    print_loop_prof(0);
+    print_loop_prof(1);
+    bus_sched_stats_t bs;
+    bus_sched_get_stats_and_reset(&bs);
+    printf("BUS HOUSE  : Ops=%lu Bus=%lu  Coalesced=%lu Forced=%lu  "
+           "Time=%lu us (max %lu us)\n",
+           (unsigned long)bs.requested, (unsigned long)bs.executed,
+           (unsigned long)bs.coalesced, (unsigned long)bs.forced,
+           (unsigned long)bs.bus_us, (unsigned long)bs.max_us);
+    report[STATS_CTR_BUS_OPS] = bs.requested;
+    report[STATS_CTR_BUS_EXECUTED] = bs.executed;
+    report[STATS_CTR_BUS_FORCED] = bs.forced;
+    printf("SPI LAT    : Max=%lu us  Last=%lu us (per bus session)\n",
            (unsigned long)prof_spi_max_us, (unsigned long)prof_spi_last_us);
+    if (batch_sessions > 0) {
+      printf("TX BATCH   : Sessions=%lu  Pkts/Session=%lu.%02lu  "
+             "SPI=%lu ns/B\n",
+             (unsigned long)batch_sessions,
+             (unsigned long)(batch_pkts / batch_sessions),
+             (unsigned long)((batch_pkts * 100 / batch_sessions) % 100),
+             (unsigned long)(batch_bytes
+                                 ? (uint64_t)batch_us * 1000 / batch_bytes
+                                 : 0));
+    }
 
     // NEW: TX gap timing (key debug info)
-    printf("TX GAP     : Max=%lu us  Avg=%lu us  (>20000 = stutter)\n",
-           (unsigned long)tx_gap_max_us, (unsigned long)tx_gap_avg);
+    printf("TX GAP     : Max=%lu us  Avg=%lu us  (>%d = stutter)\n",
+           (unsigned long)tx_gap_max_us, (unsigned long)tx_gap_avg,
+           TX_GAP_STUTTER_US);
+    report[STATS_CTR_SPI_MAX_US] = prof_spi_max_us;
+    report[STATS_CTR_TX_BATCH_SESSIONS] = batch_sessions;
+    report[STATS_CTR_TX_BATCH_PKTS] = batch_pkts;
+    report[STATS_CTR_TX_BATCH_BYTES] = batch_bytes;
+    report[STATS_CTR_TX_BATCH_US] = batch_us;
+    report[STATS_CTR_TX_GAP_MAX_US] = tx_gap_max_us;
+    report[STATS_CTR_TX_GAP_AVG_US] = tx_gap_avg;
+    report[STATS_CTR_MEDIA_PKTS] = media_gap_count;
+    report[STATS_CTR_MEDIA_GAP_MAX_US] = media_gap_max_us;
+    memcpy(report_media_hist, media_gap_hist, sizeof(media_gap_hist));
+    if (media_gap_count > 0) {
+      printf("MEDIA GAP  : Links=%u  Pkts=%lu  Max=%lu us  p50<%lu ms  "
+             "p99<%lu ms  (sched %s)\n",
+             bt_a2dp_media_links(), (unsigned long)media_gap_count,
+             (unsigned long)media_gap_max_us,
+             (unsigned long)media_gap_percentile_ms(50),
+             (unsigned long)media_gap_percentile_ms(99),
+             DONGLE_A2DP_SCHED ? "on" : "off");
+    }
+
+    adv_filter_stats_t af;
+    adv_filter_get_stats_and_reset(&af);
+    if (af.events_in > 0) {
+      printf("ADV FILTER : Events In=%lu Out=%lu  Reports=%lu Dup=%lu  "
+             "(USB events -%lu%%)\n",
+             (unsigned long)af.events_in, (unsigned long)af.events_out,
+             (unsigned long)af.reports_in, (unsigned long)af.suppressed,
+             (unsigned long)(af.events_out < af.events_in
+                                 ? 100 - (af.events_out * 100) / af.events_in
+                                 : 0));
+    }
+    report[STATS_CTR_ADV_EVENTS_IN] = af.events_in;
+    report[STATS_CTR_ADV_EVENTS_OUT] = af.events_out;
+    report[STATS_CTR_ADV_SUPPRESSED] = af.suppressed;
+
+    print_hci_stats();
+
+    bt_sco_stats_t sco;
+    bt_sco_get_stats_and_reset(&sco);
+    if (sco.in_pkts > 0 || sco.out_pkts > 0) {
+      printf("SCO        : In=%lu Out=%lu  Level=%u/%u.%02u/%u  "
+             "Drift=%+ld ppm  Drop=%lu Insert=%lu\n",
+             (unsigned long)sco.in_pkts, (unsigned long)sco.out_pkts,
+             sco.level_min, sco.level_avg_x100 / 100,
+             sco.level_avg_x100 % 100, sco.level_max, (long)sco.drift_ppm,
+             (unsigned long)sco.dropped, (unsigned long)sco.inserted);
+    }
+    if (sco.out_pkts > 0 || sco.out_dropped > 0) {
+      printf("SCO OUT    : Host=%+ld ppm  Level max=%u  Drop=%lu\n",
+             (long)sco.out_rate_ppm, sco.out_level_max,
+             (unsigned long)sco.out_dropped);
+    }
+    report[STATS_CTR_SCO_IN] = sco.in_pkts;
+    report[STATS_CTR_SCO_OUT] = sco.out_pkts;
+    report[STATS_CTR_SCO_DROPPED] = sco.dropped;
+    report[STATS_CTR_SCO_INSERTED] = sco.inserted;
+    report[STATS_CTR_SCO_OUT_DROPPED] = sco.out_dropped;
+    report[STATS_CTR_SCO_LEVEL_MIN] = sco.level_min;
+    report[STATS_CTR_SCO_LEVEL_AVG_X100] = sco.level_avg_x100;
+    report[STATS_CTR_SCO_LEVEL_MAX] = sco.level_max;
+    report[STATS_CTR_SCO_DRIFT_PPM] = (uint32_t)sco.drift_ppm;
+    report[STATS_CTR_SCO_OUT_RATE_PPM] = (uint32_t)sco.out_rate_ppm;
+    report[STATS_CTR_SCO_OUT_LEVEL_MAX] = sco.out_level_max;
+
+#if DONGLE_SCO_TRANSCODE
+    sco_codec_stats_t cs;
+    sco_codec_get_stats_and_reset(&cs);
+    if (cs.dec.frames > 0 || cs.enc.frames > 0) {
+      uint32_t peak = cs.dec.max_cycles + cs.enc.max_cycles;
+      printf("SCO CODEC  : Dec=%lu avg/max %lu/%lu cyc  Enc=%lu avg/max "
+             "%lu/%lu cyc  Budget=%lu cyc/frame (peak %lu%%)  Bad=%lu\n",
+             (unsigned long)cs.dec.frames, (unsigned long)cs.dec.avg_cycles,
+             (unsigned long)cs.dec.max_cycles, (unsigned long)cs.enc.frames,
+             (unsigned long)cs.enc.avg_cycles,
+             (unsigned long)cs.enc.max_cycles,
+             (unsigned long)cs.budget_cycles,
+             (unsigned long)(cs.budget_cycles
+                                 ? (uint64_t)peak * 100 / cs.budget_cycles
+                                 : 0),
+             (unsigned long)cs.bad_frames);
+    }
+    report[STATS_CTR_CODEC_DEC_FRAMES] = cs.dec.frames;
+    report[STATS_CTR_CODEC_DEC_AVG_CYC] = cs.dec.avg_cycles;
+    report[STATS_CTR_CODEC_DEC_MAX_CYC] = cs.dec.max_cycles;
+    report[STATS_CTR_CODEC_ENC_FRAMES] = cs.enc.frames;
+    report[STATS_CTR_CODEC_ENC_AVG_CYC] = cs.enc.avg_cycles;
+    report[STATS_CTR_CODEC_ENC_MAX_CYC] = cs.enc.max_cycles;
+    report[STATS_CTR_CODEC_BUDGET_CYC] = cs.budget_cycles;
+    report[STATS_CTR_CODEC_BAD_FRAMES] = cs.bad_frames;
+#endif
+
+    acl_frag_stats_t fr;
+    acl_frag_get_stats_and_reset(&fr);
+    if (fr.usb_xfers > 0 || fr.host_pkts > 0) {
+      printf("ACL OUT    : USB Xfers=%lu Pkts=%lu  Host=%lu pkts avg %lu B  "
+             "Split=%lu -> %lu frags  MTU %u x%u -> %u x%u  Untracked=%lu\n",
+             (unsigned long)fr.usb_xfers, (unsigned long)fr.usb_pkts,
+             (unsigned long)fr.host_pkts,
+             (unsigned long)(fr.host_pkts ? fr.host_bytes / fr.host_pkts : 0),
+             (unsigned long)fr.split, (unsigned long)fr.fragments,
+             fr.host_mtu, fr.host_bufs, fr.ctrl_mtu, fr.ctrl_bufs,
+             (unsigned long)fr.untracked);
+    }
+    report[STATS_CTR_ACL_USB_XFERS] = fr.usb_xfers;
+    report[STATS_CTR_ACL_USB_PKTS] = fr.usb_pkts;
+    report[STATS_CTR_ACL_HOST_PKTS] = fr.host_pkts;
+    report[STATS_CTR_ACL_FRAGMENTS] = fr.fragments;
 
     printf("USB ERR    : Reassembly Resets=%lu\n",
            (unsigned long)bt_hci_get_reassembly_errors());
+    report[STATS_CTR_REASSEMBLY_ERRORS] = bt_hci_get_reassembly_errors();
+    report[STATS_CTR_WINDOWS]++;
     printf("===========================\n");
 
     // Reset windowed stats
     prof_c0_loops = 0;
     prof_c1_loops = 0;
     prof_spi_max_us = 0;
+    batch_sessions = 0;
+    batch_pkts = 0;
+    batch_bytes = 0;
+    batch_us = 0;
     tx_gap_max_us = 0;
     tx_gap_count = 0;
     tx_gap_sum = 0;
+    memset(media_gap_hist, 0, sizeof(media_gap_hist));
+    media_gap_count = 0;
+    media_gap_max_us = 0;
+    TRACE(TRACE_EV_STATS_END, 0);
   }
 }
@@ -10,12 +10,126 @@ void stats_init(void);
 // Call from main loop - handles stats printing and LED
 void stats_task(void);
 
+// Loop phases for stall attribution
+typedef enum {
+  LOOP_PHASE_OTHER = 0,
+  LOOP_PHASE_TUD_TASK,
+  LOOP_PHASE_USB_SEND_WAIT,
+  LOOP_PHASE_SEND_PACKET,
+  LOOP_PHASE_STATS_TASK,
+  LOOP_PHASE_COUNT
+} loop_phase_t;
+
 // Profiling access
 void stats_update_spi_latency(uint32_t us);
+
+// One CYW43 bus session of the batched TX path
+void stats_record_tx_batch(uint32_t pkts, uint32_t bytes, uint32_t us);
+
+// Loop iteration boundaries: count iterations and time the previous one
+// (histogram + top-N slowest with the phase they spent longest in)
 void stats_increment_core0_loops(void);
 void stats_increment_core1_loops(void);
 
+// Mark the start of a phase within the calling core's loop iteration.
+// Return to LOOP_PHASE_OTHER when the phase is done.
+void stats_loop_phase(loop_phase_t phase);
+
 // Debug: Record TX send event for gap timing
 void stats_record_tx_send(void);
 
+// Record a send on an A2DP media link (media gap histogram / p99)
+void stats_record_media_tx_send(void);
+
+// LED policy: blink with TX activity (default) or hold off/on
+typedef enum {
+  STATS_LED_ACTIVITY = 0,
+  STATS_LED_OFF,
+  STATS_LED_ON,
+  STATS_LED_MODE_COUNT
+} stats_led_mode_t;
+
+void stats_set_led_mode(stats_led_mode_t mode);
+stats_led_mode_t stats_get_led_mode(void);
+
+// Counters of the last completed report window, captured when it is
+// printed (read on Core 0, e.g. by the vendor HCI commands). IDs are part
+// of the vendor command interface: append only. Signed values (ppm) are
+// two's complement. The per-opcode CMD and per-connection CONN report lines
+// are UART-only.
+typedef enum {
+  STATS_CTR_WINDOWS = 0, // Completed report windows since boot
+  STATS_CTR_WINDOW_MS,
+  STATS_CTR_RX_PKTS,
+  STATS_CTR_RX_BYTES,
+  STATS_CTR_TX_PKTS,
+  STATS_CTR_TX_BYTES,
+  STATS_CTR_RX_DROPS,
+  STATS_CTR_TX_DROPS,
+  STATS_CTR_RX_PEAK,
+  STATS_CTR_TX_PEAK,
+  STATS_CTR_TXM_PEAK,
+  STATS_CTR_TX_BUSY,
+  STATS_CTR_C0_LOOPS,
+  STATS_CTR_C1_LOOPS,
+  STATS_CTR_C0_LOOP_MAX_US,
+  STATS_CTR_C1_LOOP_MAX_US,
+  STATS_CTR_SPI_MAX_US,
+  STATS_CTR_TX_BATCH_SESSIONS,
+  STATS_CTR_TX_BATCH_PKTS,
+  STATS_CTR_TX_GAP_MAX_US,
+  STATS_CTR_TX_GAP_AVG_US,
+  STATS_CTR_MEDIA_PKTS,
+  STATS_CTR_MEDIA_GAP_MAX_US,
+  STATS_CTR_BUS_OPS,
+  STATS_CTR_BUS_EXECUTED,
+  STATS_CTR_BUS_FORCED,
+  STATS_CTR_ADV_EVENTS_IN,
+  STATS_CTR_ADV_EVENTS_OUT,
+  STATS_CTR_ADV_SUPPRESSED,
+  STATS_CTR_SCO_IN,
+  STATS_CTR_SCO_OUT,
+  STATS_CTR_SCO_DROPPED,
+  STATS_CTR_SCO_INSERTED,
+  STATS_CTR_REASSEMBLY_ERRORS,
+  STATS_CTR_ACL_USB_XFERS,
+  STATS_CTR_ACL_USB_PKTS,
+  STATS_CTR_ACL_HOST_PKTS,
+  STATS_CTR_ACL_FRAGMENTS,
+  STATS_CTR_SCO_OUT_DROPPED,
+  STATS_CTR_TX_BATCH_BYTES,
+  STATS_CTR_TX_BATCH_US,
+  STATS_CTR_SCO_LEVEL_MIN,
+  STATS_CTR_SCO_LEVEL_AVG_X100,
+  STATS_CTR_SCO_LEVEL_MAX,
+  STATS_CTR_SCO_DRIFT_PPM,    // int32, since the alt setting was selected
+  STATS_CTR_SCO_OUT_RATE_PPM, // int32, same
+  STATS_CTR_SCO_OUT_LEVEL_MAX,
+  STATS_CTR_CODEC_DEC_FRAMES,  // Codec values stay 0 without
+  STATS_CTR_CODEC_DEC_AVG_CYC, // DONGLE_SCO_TRANSCODE
+  STATS_CTR_CODEC_DEC_MAX_CYC,
+  STATS_CTR_CODEC_ENC_FRAMES,
+  STATS_CTR_CODEC_ENC_AVG_CYC,
+  STATS_CTR_CODEC_ENC_MAX_CYC,
+  STATS_CTR_CODEC_BUDGET_CYC,
+  STATS_CTR_CODEC_BAD_FRAMES,
+  STATS_CTR_COUNT
+} stats_counter_t;
+
+// Histograms of the last completed window: loop iteration time per core
+// (log2 us buckets) and A2DP media TX gap (1 ms buckets)
+typedef enum {
+  STATS_HIST_LOOP_C0 = 0,
+  STATS_HIST_LOOP_C1,
+  STATS_HIST_MEDIA_GAP,
+  STATS_HIST_COUNT
+} stats_hist_t;
+
+uint32_t stats_get_counter(stats_counter_t id);
+
+// Copies up to max buckets starting at first; returns the number copied.
+// *total receives the histogram's bucket count.
+uint8_t stats_get_histogram(stats_hist_t id, uint8_t first, uint32_t *out,
+                            uint8_t max, uint8_t *total);
+
 #endif // STATS_H
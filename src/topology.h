@@ -0,0 +1,49 @@
+// topology.h - Assignment of the forwarding roles to the RP2 cores
+// The firmware has two roles: the CYW43 side (controller link, TX drain,
+// stats) and the USB side (TinyUSB, RX drain). "Core 0" and "Core 1" in
+// comments across the sources name these roles as they run in the default
+// DUAL topology; each role's single-writer data stays with the role, so the
+// ownership rules hold in every topology.
+//   DUAL    - CYW43 side on Core 0, USB side on Core 1 (default)
+//   SWAPPED - USB side on Core 0, CYW43 side on Core 1
+//   SINGLE  - both on Core 0, Core 1 left free; packets are handed over
+//             between the CYW43 IRQ and the loop through the same queues
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include "pico.h"
+
+#define DONGLE_TOPOLOGY_DUAL 0
+#define DONGLE_TOPOLOGY_SWAPPED 1
+#define DONGLE_TOPOLOGY_SINGLE 2
+
+#ifndef DONGLE_CORE_TOPOLOGY
+#define DONGLE_CORE_TOPOLOGY DONGLE_TOPOLOGY_DUAL
+#endif
+
+#if DONGLE_CORE_TOPOLOGY == DONGLE_TOPOLOGY_DUAL
+#define CYW43_CORE 0
+#define USB_CORE 1
+#define DONGLE_TOPOLOGY_NAME "dual"
+#elif DONGLE_CORE_TOPOLOGY == DONGLE_TOPOLOGY_SWAPPED
+#define CYW43_CORE 1
+#define USB_CORE 0
+#define DONGLE_TOPOLOGY_NAME "swapped"
+#elif DONGLE_CORE_TOPOLOGY == DONGLE_TOPOLOGY_SINGLE
+#define CYW43_CORE 0
+#define USB_CORE 0
+#define DONGLE_TOPOLOGY_NAME "single"
+#else
+#error "DONGLE_CORE_TOPOLOGY must be DUAL (0), SWAPPED (1) or SINGLE (2)"
+#endif
+
+// Publish/acquire barrier for the SPSC handoffs between the two roles. On a
+// single core the other side is an IRQ, which sees this core's stores in
+// program order: only the compiler must not reorder them.
+#if CYW43_CORE != USB_CORE
+#define ROLE_BARRIER() __dmb()
+#else
+#define ROLE_BARRIER() __compiler_memory_barrier()
+#endif
+
+#endif // TOPOLOGY_H
@@ -0,0 +1,93 @@
+// trace.c - Per-core event tracing for BT dongle
+// Dump format (one event per line, hex):
+//   TR BEGIN <ring_size>
+//   TR <core> <ts_us> <tag>
+//   TR END
+#include "trace.h"
+
+#if DONGLE_TRACE
+
+#include "pico/stdlib.h"
+#include "topology.h"
+#include <stdio.h>
+#include <string.h>
+
+// A dump line (~24 chars) fits the 32-byte UART FIFO, so pacing lines keeps
+// printf from ever blocking the Core 0 loop (115200 baud ~ 87us/char)
+#define TRACE_DUMP_LINE_INTERVAL_US 2500
+#define TRACE_KEY_POLL_INTERVAL_US 50000
+
+trace_ring_t trace_rings[NUM_CORES];
+volatile bool trace_frozen = false;
+
+static volatile bool dump_requested = false;
+static bool dumping = false;
+static uint8_t dump_core = 0;
+static uint32_t dump_pos = 0;
+static uint32_t dump_end = 0;
+static uint32_t last_poll_us = 0;
+
+void __not_in_flash_func(trace_trigger)(uint32_t duration_us) {
+  if (trace_frozen)
+    return;
+  TRACE(TRACE_EV_TRIGGER, duration_us > 0xFFFFFF ? 0xFFFFFF : duration_us);
+  trace_frozen = true;
+  dump_requested = true;
+}
+
+static void dump_start_core(uint8_t core) {
+  dump_core = core;
+  dump_end = trace_rings[core].idx;
+  dump_pos = dump_end - TRACE_RING_SIZE; // Empty slots are skipped
+}
+
+void __not_in_flash_func(trace_task)(void) {
+  uint32_t now = time_us_32();
+
+  if (!dumping) {
+    if (now - last_poll_us < TRACE_KEY_POLL_INTERVAL_US)
+      return;
+    last_poll_us = now;
+
+    int c = getchar_timeout_us(0);
+    if (c == 't' || c == 'T') {
+      trace_frozen = true;
+      dump_requested = true;
+    }
+    if (!dump_requested)
+      return;
+
+    dump_requested = false;
+    dumping = true;
+    printf("TR BEGIN %u\n", TRACE_RING_SIZE);
+    dump_start_core(0);
+    return;
+  }
+
+  if (now - last_poll_us < TRACE_DUMP_LINE_INTERVAL_US)
+    return;
+  last_poll_us = now;
+
+  while (dump_pos != dump_end) {
+    const trace_event_t *e =
+        &trace_rings[dump_core].ev[dump_pos++ & (TRACE_RING_SIZE - 1)];
+    if ((e->tag & 0xFF) == TRACE_EV_NONE)
+      continue;
+    printf("TR %u %08lx %08lx\n", dump_core, (unsigned long)e->ts,
+           (unsigned long)e->tag);
+    return;
+  }
+
+  if (dump_core + 1 < NUM_CORES) {
+    dump_start_core(dump_core + 1);
+    return;
+  }
+
+  printf("TR END\n");
+  memset(trace_rings, 0, sizeof(trace_rings));
+  dumping = false;
+  ROLE_BARRIER();
+  trace_frozen = false;
+}
+
+#endif // DONGLE_TRACE
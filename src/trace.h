@@ -0,0 +1,86 @@
+// trace.h - Per-core event tracing for BT dongle
+// Compile-time gated (DONGLE_TRACE). Each core records compact 8-byte events
+// into its own ring; the rings are dumped over UART and converted to a
+// Chrome/Perfetto trace with tools/trace_to_perfetto.py
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "hardware/timer.h"
+#include "pico.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef DONGLE_TRACE
+#define DONGLE_TRACE 0
+#endif
+
+// Events per core (power of 2). 1024 * 8 bytes = 8KB per core.
+#ifndef TRACE_RING_SIZE
+#define TRACE_RING_SIZE 1024
+#endif
+
+// Event IDs (keep in sync with tools/trace_to_perfetto.py)
+typedef enum {
+  TRACE_EV_NONE = 0,
+  TRACE_EV_RX_ENQUEUE,     // arg = size
+  TRACE_EV_RX_DEQUEUE,     // arg = 0
+  TRACE_EV_TX_ENQUEUE,     // arg = size
+  TRACE_EV_TX_DEQUEUE,     // arg = 0
+  TRACE_EV_QUEUE_DROP,     // arg = 0 (RX) / 1 (TX)
+  TRACE_EV_SEND_BEGIN,     // arg = size
+  TRACE_EV_SEND_END,       // arg = result (0 = ok)
+  TRACE_EV_TUD_TASK_BEGIN, // arg = 0
+  TRACE_EV_TUD_TASK_END,   // arg = 0
+  TRACE_EV_USB_SEND,       // arg = size accepted by TinyUSB
+  TRACE_EV_SCO_FRAME,      // arg = size
+  TRACE_EV_STATS_BEGIN,    // arg = 0
+  TRACE_EV_STATS_END,      // arg = 0
+  TRACE_EV_TRIGGER,        // arg = gap/stall duration in us (saturated)
+  TRACE_EV_SCO_LEVEL,      // arg = SCO IN ring level (packets) at ISO send
+  TRACE_EV_COUNT
+} trace_event_id_t;
+
+typedef struct {
+  uint32_t ts;  // time_us_32()
+  uint32_t tag; // id (8 bits) | arg (24 bits) << 8
+} trace_event_t;
+
+typedef struct {
+  trace_event_t ev[TRACE_RING_SIZE];
+  volatile uint32_t idx; // Total events written (wraps)
+} trace_ring_t;
+
+#if DONGLE_TRACE
+
+extern trace_ring_t trace_rings[NUM_CORES];
+extern volatile bool trace_frozen;
+
+// Record one event on the calling core. An IRQ preempting a record on the
+// same core may overwrite one slot; acceptable for diagnostics.
+static inline void trace_record(uint8_t id, uint32_t arg) {
+  if (trace_frozen)
+    return;
+  trace_ring_t *r = &trace_rings[get_core_num()];
+  uint32_t i = r->idx;
+  trace_event_t *e = &r->ev[i & (TRACE_RING_SIZE - 1)];
+  e->ts = time_us_32();
+  e->tag = id | (arg << 8);
+  r->idx = i + 1;
+}
+
+#define TRACE(id, arg) trace_record((id), (uint32_t)(arg))
+
+// Freeze the rings and schedule a dump (e.g. on a TX gap spike)
+void trace_trigger(uint32_t duration_us);
+
+// Call from Core 0 loop: starts a dump on UART 't' key or trigger, and emits
+// the dump incrementally (one line per call) so it never blocks the loop
+void trace_task(void);
+
+#else
+#define TRACE(id, arg) ((void)0)
+#define trace_trigger(duration_us) ((void)0)
+#define trace_task() ((void)0)
+#endif
+
+#endif // TRACE_H
@@ -0,0 +1,395 @@
+// vendor_cmd.c - Dongle vendor HCI commands for BT dongle
+// Commands cross from Core 1 to Core 0 through a small SPSC mailbox. Core 0
+// owns the stats snapshot and most tunables, and queues the response with
+// the CYW43 lock held so the RX queue keeps a single producer (the CYW43
+// packet handler runs from an IRQ on the same core).
+#include "vendor_cmd.h"
+#include "acl_frag.h"
+#include "adv_filter.h"
+#include "bt_a2dp.h"
+#include "bt_sco.h"
+#include "btstack.h"
+#include "hardware/clocks.h"
+#include "hardware/uart.h"
+#include "hci_packet_queue.h"
+#include "pico.h"
+#include "pico/cyw43_arch.h"
+#include "pico/stdlib.h"
+#include "placement.h"
+#include "sco_codec.h"
+#include "stats.h"
+#include "topology.h"
+#include "trace.h"
+#include <string.h>
+
+#define VND_MAILBOX_SIZE 4 // Power of 2
+#define VND_MAX_PARAMS 8
+
+// HCI
+#define HCI_EVT_COMMAND_COMPLETE 0x0E
+#define HCI_EVT_MAX_PARAMS 255
+#define HCI_CC_HDR_LEN 3 // Num_HCI_Command_Packets, opcode
+#define HCI_SUCCESS 0x00
+#define HCI_ERR_UNKNOWN_COMMAND 0x01
+#define HCI_ERR_COMMAND_DISALLOWED 0x0C
+#define HCI_ERR_INVALID_PARAMS 0x12
+
+// Return parameter space after the status byte
+#define VND_RET_MAX (HCI_EVT_MAX_PARAMS - HCI_CC_HDR_LEN - 1)
+
+#define VND_TX_BATCH_LIMIT 16
+#define VND_ADV_DEDUP_MS_MAX 10000
+#define VND_ADV_COALESCE_US_MAX 50000
+// Keeps clk_sys well above clk_usb (48 MHz)
+#define VND_CLOCK_MIN_KHZ 96000
+
+typedef struct {
+  uint16_t opcode;
+  uint8_t len; // Parameter bytes received (may exceed VND_MAX_PARAMS)
+  uint8_t params[VND_MAX_PARAMS];
+} vnd_cmd_t;
+
+static vnd_cmd_t mailbox[VND_MAILBOX_SIZE];
+static volatile uint8_t USB_CORE_DATA("vnd") mb_head = 0;
+static volatile uint8_t CYW43_CORE_DATA("vnd") mb_tail = 0;
+
+// Opcodes refused while the mailbox was full, answered with Command
+// Disallowed so the host never waits for a Command Complete
+static uint16_t rejected[VND_MAILBOX_SIZE];
+static volatile uint8_t USB_CORE_DATA("vnd") rj_head = 0;
+static volatile uint8_t CYW43_CORE_DATA("vnd") rj_tail = 0;
+
+// Response waiting for room in the RX queue (Core 0)
+static uint8_t rsp[2 + HCI_EVT_MAX_PARAMS];
+static uint16_t rsp_len = 0;
+
+static uint32_t boot_khz = 0;
+
+static inline uint16_t rd16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+static inline uint32_t rd32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint8_t *wr32(uint8_t *p, uint32_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+  return p + 4;
+}
+
+void vendor_cmd_init(void) {
+  mb_head = mb_tail = 0;
+  rj_head = rj_tail = 0;
+  rsp_len = 0;
+  boot_khz = clock_get_hz(clk_sys) / 1000;
+}
+
+// --- Core 1 ---
+
+void __not_in_flash_func(vendor_cmd_submit)(const uint8_t *cmd,
+                                            size_t cmd_len) {
+  uint8_t head = mb_head;
+  // The host keeps one command outstanding (Num_HCI_Command_Packets = 1);
+  // one that floods the mailbox gets its commands refused
+  if ((uint8_t)(head - mb_tail) >= VND_MAILBOX_SIZE) {
+    uint8_t rj = rj_head;
+    if ((uint8_t)(rj - rj_tail) >= VND_MAILBOX_SIZE)
+      return;
+    rejected[rj & (VND_MAILBOX_SIZE - 1)] = rd16(cmd);
+    ROLE_BARRIER();
+    rj_head = rj + 1;
+    return;
+  }
+  vnd_cmd_t *c = &mailbox[head & (VND_MAILBOX_SIZE - 1)];
+  c->opcode = rd16(cmd);
+  c->len = 0;
+  if (cmd_len > 3)
+    c->len = cmd[2] < cmd_len - 3 ? cmd[2] : (uint8_t)(cmd_len - 3);
+  memcpy(c->params, &cmd[3],
+         c->len < VND_MAX_PARAMS ? c->len : VND_MAX_PARAMS);
+  ROLE_BARRIER();
+  mb_head = head + 1;
+}
+
+// --- Core 0: tunables ---
+
+static bool set_sys_clock(uint32_t khz) {
+#ifdef uart_default
+  uart_tx_wait_blocking(uart_default);
+#endif
+  // No bus transfer in flight while the clock switches
+  cyw43_thread_enter();
+  bool ok = set_sys_clock_khz(khz, false);
+  cyw43_thread_exit();
+#ifdef uart_default
+  // clk_peri follows clk_sys
+  if (ok)
+    uart_set_baudrate(uart_default, PICO_DEFAULT_UART_BAUD_RATE);
+#endif
+  return ok;
+}
+
+static void tunable_range(vendor_tunable_t id, uint32_t *min, uint32_t *max) {
+  *min = 0;
+  switch (id) {
+  case VND_TUNE_TX_BATCH_MAX:
+    *min = 1;
+    *max = VND_TX_BATCH_LIMIT;
+    break;
+  case VND_TUNE_RESERVE_CRITICAL:
+  case VND_TUNE_RESERVE_ACL:
+    *max = HCI_PACKET_QUEUE_SIZE - 2;
+    break;
+  case VND_TUNE_ADV_FILTER:
+    *max = 1;
+    break;
+  case VND_TUNE_ADV_DEDUP_MS:
+    *max = VND_ADV_DEDUP_MS_MAX;
+    break;
+  case VND_TUNE_ADV_COALESCE_US:
+    *max = VND_ADV_COALESCE_US_MAX;
+    break;
+  case VND_TUNE_LED_MODE:
+    *max = STATS_LED_MODE_COUNT - 1;
+    break;
+  case VND_TUNE_SCO_LEVEL_TARGET:
+  case VND_TUNE_SCO_LEVEL_HIGH:
+    *min = 1;
+    *max = SCO_RING_SIZE - 1;
+    break;
+  case VND_TUNE_SYS_CLOCK_KHZ:
+    *min = VND_CLOCK_MIN_KHZ;
+    *max = boot_khz;
+    break;
+  default:
+    *max = 0;
+    break;
+  }
+}
+
+static uint32_t tunable_get(vendor_tunable_t id) {
+  uint8_t a, b;
+  switch (id) {
+  case VND_TUNE_TX_BATCH_MAX:
+    return tx_get_batch_max();
+  case VND_TUNE_RESERVE_CRITICAL:
+  case VND_TUNE_RESERVE_ACL:
+    hci_packet_queue_get_reserves(&a, &b);
+    return id == VND_TUNE_RESERVE_CRITICAL ? a : b;
+  case VND_TUNE_ADV_FILTER:
+    return adv_filter_get_enabled();
+  case VND_TUNE_ADV_DEDUP_MS:
+    return adv_filter_get_dedup_window_ms();
+  case VND_TUNE_ADV_COALESCE_US:
+    return adv_filter_get_coalesce_us();
+  case VND_TUNE_LED_MODE:
+    return stats_get_led_mode();
+  case VND_TUNE_SCO_LEVEL_TARGET:
+  case VND_TUNE_SCO_LEVEL_HIGH:
+    bt_sco_get_levels(&a, &b);
+    return id == VND_TUNE_SCO_LEVEL_TARGET ? a : b;
+  case VND_TUNE_SYS_CLOCK_KHZ:
+    return clock_get_hz(clk_sys) / 1000;
+  default:
+    return 0;
+  }
+}
+
+// Cross-field constraints (reserves, SCO levels) are checked by the owner
+static bool tunable_set(vendor_tunable_t id, uint32_t v) {
+  uint32_t min, max;
+  tunable_range(id, &min, &max);
+  if (id >= VND_TUNE_COUNT || v < min || v > max)
+    return false;
+
+  uint8_t a, b;
+  switch (id) {
+  case VND_TUNE_TX_BATCH_MAX:
+    tx_set_batch_max((uint8_t)v);
+    return true;
+  case VND_TUNE_RESERVE_CRITICAL:
+  case VND_TUNE_RESERVE_ACL:
+    hci_packet_queue_get_reserves(&a, &b);
+    if (id == VND_TUNE_RESERVE_CRITICAL)
+      a = (uint8_t)v;
+    else
+      b = (uint8_t)v;
+    return hci_packet_queue_set_reserves(a, b);
+  case VND_TUNE_ADV_FILTER:
+    adv_filter_set_enabled(v != 0);
+    return true;
+  case VND_TUNE_ADV_DEDUP_MS:
+    adv_filter_set_dedup_window_ms(v);
+    return true;
+  case VND_TUNE_ADV_COALESCE_US:
+    adv_filter_set_coalesce_us(v);
+    return true;
+  case VND_TUNE_LED_MODE:
+    stats_set_led_mode((stats_led_mode_t)v);
+    return true;
+  case VND_TUNE_SCO_LEVEL_TARGET:
+  case VND_TUNE_SCO_LEVEL_HIGH:
+    bt_sco_get_levels(&a, &b);
+    if (id == VND_TUNE_SCO_LEVEL_TARGET)
+      a = (uint8_t)v;
+    else
+      b = (uint8_t)v;
+    return bt_sco_set_levels(a, b);
+  case VND_TUNE_SYS_CLOCK_KHZ:
+    return set_sys_clock(v);
+  default:
+    return false;
+  }
+}
+
+// --- Core 0: commands ---
+
+// Fills the return parameters after the status byte; returns their length
+static uint8_t execute(const vnd_cmd_t *c, uint8_t *status, uint8_t *out) {
+  uint8_t *p = out;
+  *status = HCI_SUCCESS;
+
+  switch (c->opcode) {
+  case VND_OPCODE_READ_INFO: {
+    uint16_t flags = (DONGLE_TRACE ? VND_FLAG_TRACE : 0) |
+                     (DONGLE_SRAM_PLACEMENT ? VND_FLAG_SRAM_PLACEMENT : 0) |
+                     (DONGLE_ADV_FILTER ? VND_FLAG_ADV_FILTER : 0) |
+                     (DONGLE_A2DP_SCHED ? VND_FLAG_A2DP_SCHED : 0) |
+                     (DONGLE_SCO_TRANSCODE ? VND_FLAG_SCO_TRANSCODE : 0) |
+                     (DONGLE_ACL_FRAG ? VND_FLAG_ACL_FRAG : 0);
+    *p++ = VND_REVISION;
+    *p++ = DONGLE_CORE_TOPOLOGY;
+    *p++ = CYW43_CORE;
+    *p++ = USB_CORE;
+    *p++ = flags & 0xFF;
+    *p++ = flags >> 8;
+    p = wr32(p, clock_get_hz(clk_sys) / 1000);
+    p = wr32(p, boot_khz);
+    *p++ = HCI_PACKET_QUEUE_SIZE;
+    *p++ = HCI_PACKET_QUEUE_SIZE;
+    *p++ = HCI_PACKET_PRIO_QUEUE_SIZE;
+    *p++ = STATS_CTR_COUNT;
+    *p++ = STATS_HIST_COUNT;
+    *p++ = VND_TUNE_COUNT;
+    break;
+  }
+
+  case VND_OPCODE_READ_COUNTERS: {
+    if (c->len < 1) {
+      *status = HCI_ERR_INVALID_PARAMS;
+      break;
+    }
+    uint8_t first = c->params[0];
+    uint8_t n = 0;
+    uint8_t max = (VND_RET_MAX - 2) / 4;
+    *p++ = first;
+    uint8_t *np = p++;
+    while (n < max && first + n < STATS_CTR_COUNT) {
+      p = wr32(p, stats_get_counter((stats_counter_t)(first + n)));
+      n++;
+    }
+    *np = n;
+    break;
+  }
+
+  case VND_OPCODE_READ_HISTOGRAM: {
+    if (c->len < 2 || c->params[0] >= STATS_HIST_COUNT) {
+      *status = HCI_ERR_INVALID_PARAMS;
+      break;
+    }
+    uint32_t buckets[(VND_RET_MAX - 4) / 4];
+    uint8_t total;
+    uint8_t n = stats_get_histogram((stats_hist_t)c->params[0], c->params[1],
+                                    buckets, count_of(buckets), &total);
+    *p++ = c->params[0];
+    *p++ = total;
+    *p++ = c->params[1];
+    *p++ = n;
+    for (uint8_t i = 0; i < n; i++)
+      p = wr32(p, buckets[i]);
+    break;
+  }
+
+  case VND_OPCODE_READ_TUNABLE: {
+    if (c->len < 1 || c->params[0] >= VND_TUNE_COUNT) {
+      *status = HCI_ERR_INVALID_PARAMS;
+      break;
+    }
+    vendor_tunable_t id = (vendor_tunable_t)c->params[0];
+    uint32_t min, max;
+    tunable_range(id, &min, &max);
+    *p++ = id;
+    p = wr32(p, tunable_get(id));
+    p = wr32(p, min);
+    p = wr32(p, max);
+    break;
+  }
+
+  case VND_OPCODE_WRITE_TUNABLE: {
+    if (c->len < 5 || c->params[0] >= VND_TUNE_COUNT) {
+      *status = HCI_ERR_INVALID_PARAMS;
+      break;
+    }
+    vendor_tunable_t id = (vendor_tunable_t)c->params[0];
+    if (!tunable_set(id, rd32(&c->params[1])))
+      *status = HCI_ERR_INVALID_PARAMS;
+    *p++ = id;
+    p = wr32(p, tunable_get(id));
+    break;
+  }
+
+  default:
+    *status = HCI_ERR_UNKNOWN_COMMAND;
+    break;
+  }
+  return (uint8_t)(p - out);
+}
+
+// Command Complete header around the status at rsp[5] and ret_len return
+// parameters
+static inline void rsp_header(uint16_t opcode, uint8_t ret_len) {
+  rsp[0] = HCI_EVT_COMMAND_COMPLETE;
+  rsp[1] = HCI_CC_HDR_LEN + 1 + ret_len;
+  rsp[2] = 1; // Num_HCI_Command_Packets
+  rsp[3] = opcode & 0xFF;
+  rsp[4] = opcode >> 8;
+  rsp_len = 2 + rsp[1];
+}
+
+static bool __not_in_flash_func(rsp_flush)(void) {
+  // Same lock the CYW43 packet handler runs under: one RX producer
+  cyw43_thread_enter();
+  bool ok = hci_rx_enqueue(HCI_EVENT_PACKET, rsp, rsp_len);
+  cyw43_thread_exit();
+  if (ok)
+    rsp_len = 0;
+  return ok;
+}
+
+void __not_in_flash_func(vendor_cmd_task)(void) {
+  if (rsp_len > 0 && !rsp_flush())
+    return; // RX queue full, retry next loop
+
+  while (mb_tail != mb_head) {
+    ROLE_BARRIER();
+    const vnd_cmd_t *c = &mailbox[mb_tail & (VND_MAILBOX_SIZE - 1)];
+    uint8_t ret_len = execute(c, &rsp[5], &rsp[6]);
+    rsp_header(c->opcode, ret_len);
+    ROLE_BARRIER();
+    mb_tail++;
+    if (!rsp_flush())
+      return;
+  }
+
+  while (rj_tail != rj_head) {
+    ROLE_BARRIER();
+    rsp[5] = HCI_ERR_COMMAND_DISALLOWED;
+    rsp_header(rejected[rj_tail & (VND_MAILBOX_SIZE - 1)], 0);
+    ROLE_BARRIER();
+    rj_tail++;
+    if (!rsp_flush())
+      return;
+  }
+}
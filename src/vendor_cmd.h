@@ -0,0 +1,77 @@
+// vendor_cmd.h - Dongle vendor HCI commands for runtime tuning and readout
+// Opcodes 0xFFE0-0xFFEF (OGF 0x3F, OCF 0x3E0-0x3EF) are answered by the
+// dongle and never forwarded to the CYW43; the rest of OGF 0x3F still goes
+// to the controller. Core 1 hands each command to Core 0, which executes it
+// and queues a Command Complete event on the RX path.
+//
+//   OCF    Command         Parameters      Return parameters
+//   0x3E0  Read Info       -               status, rev, topology, CYW43
+//                                          core, USB core, flags (2),
+//                                          clock kHz (4), boot clock kHz
+//                                          (4), RX/TX/TXM queue sizes,
+//                                          counters, histograms, tunables
+//   0x3E1  Read Counters   first           status, first, n, value[n] (4)
+//   0x3E2  Read Histogram  id, first       status, id, total, first, n,
+//                                          bucket[n] (4)
+//   0x3E3  Read Tunable    id              status, id, value (4), min (4),
+//                                          max (4)
+//   0x3E4  Write Tunable   id, value (4)   status, id, value (4)
+//
+// Values are little endian. Counters and histograms are those of the last
+// completed 10 s report window (stats_counter_t / stats_hist_t).
+// Example, TX batch of 8: hcitool cmd 0x3f 0x3e4 0x00 0x08 0x00 0x00 0x00
+#ifndef VENDOR_CMD_H
+#define VENDOR_CMD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define VND_OPCODE_READ_INFO 0xFFE0
+#define VND_OPCODE_READ_COUNTERS 0xFFE1
+#define VND_OPCODE_READ_HISTOGRAM 0xFFE2
+#define VND_OPCODE_READ_TUNABLE 0xFFE3
+#define VND_OPCODE_WRITE_TUNABLE 0xFFE4
+
+// Read Info: interface revision and build flags
+#define VND_REVISION 1
+#define VND_FLAG_TRACE 0x0001
+#define VND_FLAG_SRAM_PLACEMENT 0x0002
+#define VND_FLAG_ADV_FILTER 0x0004 // Build default; see the tunable
+#define VND_FLAG_A2DP_SCHED 0x0008
+#define VND_FLAG_SCO_TRANSCODE 0x0010
+#define VND_FLAG_ACL_FRAG 0x0020
+
+// Tunable IDs (append only)
+typedef enum {
+  VND_TUNE_TX_BATCH_MAX = 0,  // Packets per CYW43 bus session
+  VND_TUNE_RESERVE_CRITICAL,  // Queue slots kept for critical packets
+  VND_TUNE_RESERVE_ACL,       // Queue slots kept for ACL and critical
+  VND_TUNE_ADV_FILTER,        // 0 = off, 1 = on
+  VND_TUNE_ADV_DEDUP_MS,      // Duplicate report window
+  VND_TUNE_ADV_COALESCE_US,   // Report coalescing window (0 = off)
+  VND_TUNE_LED_MODE,          // stats_led_mode_t
+  VND_TUNE_SCO_LEVEL_TARGET,  // SCO IN prefill level (packets)
+  VND_TUNE_SCO_LEVEL_HIGH,    // SCO IN drop watermark (packets)
+  VND_TUNE_SYS_CLOCK_KHZ,     // System clock, up to the boot clock
+  VND_TUNE_COUNT
+} vendor_tunable_t;
+
+static inline bool vendor_cmd_is_local(uint16_t opcode) {
+  return (opcode & 0xFFF0) == 0xFFE0;
+}
+
+// Call after the system clock is set (records it as the tuning ceiling)
+void vendor_cmd_init(void);
+
+// Core 1: take a dongle command from the host (full HCI command packet)
+void vendor_cmd_submit(const uint8_t *cmd, size_t cmd_len);
+
+// Core 0 loop: execute pending commands and queue their responses
+void vendor_cmd_task(void);
+
+// TX drain batch size, owned by main.c
+void tx_set_batch_max(uint8_t n);
+uint8_t tx_get_batch_max(void);
+
+#endif // VENDOR_CMD_H
@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+"""Build-time check that forward-path functions are not executed from XIP flash.
+
+Usage:
+    check_ram_resident.py --nm <nm> <elf> FUNC... [--warn FUNC...]
+
+Functions listed before --warn must resolve to SRAM (or boot ROM); any that
+land in flash fail the build. Functions after --warn (e.g. TinyUSB internals
+that cannot be annotated with __not_in_flash_func) are only reported.
+Functions not found in the ELF are reported as notes (usually inlined).
+"""
+import argparse
+import subprocess
+import sys
+
+ROM = (0x00000000, 0x00008000)
+SRAM = (0x20000000, 0x20082000)  # Covers RP2040 and RP2350 incl. scratch
+FLASH = (0x10000000, 0x14000000)
+
+
+def region(addr):
+    if ROM[0] <= addr < ROM[1]:
+        return "rom"
+    if SRAM[0] <= addr < SRAM[1]:
+        return "ram"
+    if FLASH[0] <= addr < FLASH[1]:
+        return "flash"
+    return "other"
+
+
+def load_symbols(nm, elf):
+    out = subprocess.run([nm, "--defined-only", elf], check=True,
+                         capture_output=True, text=True).stdout
+    syms = {}
+    for line in out.splitlines():
+        parts = line.split()
+        if len(parts) == 3 and parts[1] in "tT":
+            # Thumb function addresses may carry bit 0
+            syms.setdefault(parts[2], int(parts[0], 16) & ~1)
+    return syms
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--nm", required=True)
+    ap.add_argument("elf")
+    ap.add_argument("funcs", nargs="*")
+    ap.add_argument("--warn", nargs="*", default=[])
+    args = ap.parse_args()
+
+    syms = load_symbols(args.nm, args.elf)
+    errors = 0
+    for name in args.funcs + args.warn:
+        required = name in args.funcs
+        if name not in syms:
+            print("check_ram_resident: note: %s not found (inlined?)" % name)
+            continue
+        where = region(syms[name])
+        if where in ("ram", "rom"):
+            continue
+        level = "error" if required else "warning"
+        print("check_ram_resident: %s: %s is in %s (0x%08x)" %
+              (level, name, where, syms[name]))
+        if required:
+            errors += 1
+
+    if errors:
+        print("check_ram_resident: mark the functions above "
+              "__not_in_flash_func()")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,464 @@
+// hci_replay.c - Replay a btsnoop capture through the dongle's HCI path
+//
+// Runs the firmware's forwarding modules (bt_hci, bt_a2dp, adv_filter,
+// hci_packet_queue, hci_stats) on the host against a virtual clock:
+//  - host -> controller: commands into tud_bt_hci_cmd_cb(), ACL data into
+//    tud_bt_acl_data_received_cb() in 64-byte chunks (USB FS bulk OUT)
+//  - controller -> host: events and ACL data into hci_packet_handler()
+// Core 0 (TX drain to the CYW43) and Core 1 (RX drain to USB) are modeled
+// as consumers with a fixed per-packet plus per-byte cost. With -t single
+// both drains share one core and alternate like core_loop(): up to
+// TX_BATCH_MAX TX packets, then one RX packet (DUAL and SWAPPED model the
+// same: one core per drain).
+//
+// Usage:
+//   hci_replay [options] capture.btsnoop
+//     -s SPEED  Replay at SPEED x the capture timing (default 1)
+//     -f        As fast as possible: deliver each direction while its
+//               queue is less than half full (flow-controlled host/chip)
+//     -a        Enable the LE advertising filter
+//     -c US,NS  CYW43 cost per packet (us) and per byte (ns)
+//     -u US,NS  USB cost per transfer (us) and per byte (ns)
+//     -t TOPO   Core topology: dual (default), swapped or single
+//
+// Supported datalinks: 1001 (H1), 1002 (H4), 2001 (Linux monitor/btmon).
+// SCO packets are counted but not replayed. Controller ACL flow control
+// (Number of Completed Packets) is taken from the capture, not modeled.
+#include "adv_filter.h"
+#include "bt_a2dp.h"
+#include "bt_hci.h"
+#include "btstack.h"
+#include "hci_packet_queue.h"
+#include "hci_stats.h"
+#include "vendor_cmd.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define USB_BULK_CHUNK 64
+#define TX_BATCH_MAX 4 // As in main.c
+#define MAX_STEP_US 1000 // Lets the adv filter flush on time
+
+#define BTSNOOP_H1 1001
+#define BTSNOOP_H4 1002
+#define BTSNOOP_MONITOR 2001
+
+// btsnoop timestamps: microseconds since 0000-01-01
+#define BTSNOOP_FLAG_RECEIVED 0x01
+#define BTSNOOP_FLAG_CMD_EVT 0x02
+
+uint64_t replay_now_us = 0;
+
+typedef struct {
+  uint64_t ts;
+  bool to_host; // Controller -> host
+  uint8_t type;
+  uint16_t len;
+  const uint8_t *data;
+} record_t;
+
+typedef struct {
+  uint32_t *v;
+  size_t n, cap;
+} samples_t;
+
+typedef struct {
+  uint32_t pkts;
+  uint64_t bytes;
+  samples_t lat; // Enqueue -> handed to CYW43 / USB
+} dir_t;
+
+static dir_t tx_dir, rx_dir;
+static uint32_t n_sco = 0;
+static uint32_t n_skipped = 0;
+
+// --- Firmware hooks not built for the host ---
+
+void stats_record_media_tx_send(void) {}
+
+// Dongle vendor commands are answered by the dongle (vendor_cmd.c), not
+// modeled in replay
+void vendor_cmd_submit(const uint8_t *cmd, size_t cmd_len) {
+  (void)cmd;
+  (void)cmd_len;
+}
+
+void bt_sco_rx_packet(const uint8_t *packet, uint16_t size) {
+  (void)packet;
+  (void)size;
+  n_sco++;
+}
+
+void bt_sco_set_voice_setting(uint16_t setting) { (void)setting; }
+
+// --- Helpers ---
+
+static uint32_t be32(const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+         ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void sample_add(samples_t *s, uint32_t v) {
+  if (s->n == s->cap) {
+    s->cap = s->cap ? s->cap * 2 : 1024;
+    s->v = realloc(s->v, s->cap * sizeof(uint32_t));
+    if (!s->v) {
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+    }
+  }
+  s->v[s->n++] = v;
+}
+
+static int cmp_u32(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+static uint32_t percentile(const samples_t *s, uint32_t pct) {
+  if (s->n == 0)
+    return 0;
+  size_t i = (s->n * pct) / 100;
+  return s->v[i < s->n ? i : s->n - 1];
+}
+
+// --- btsnoop ---
+
+// Map one btsnoop record to an HCI packet type and direction. Returns false
+// for records that carry no HCI packet (index/system notes).
+static bool classify(uint32_t datalink, uint32_t flags, const uint8_t **data,
+                     uint32_t *len, uint8_t *type, bool *to_host) {
+  switch (datalink) {
+  case BTSNOOP_H1:
+    *to_host = flags & BTSNOOP_FLAG_RECEIVED;
+    if (flags & BTSNOOP_FLAG_CMD_EVT)
+      *type = *to_host ? HCI_EVENT_PACKET : HCI_COMMAND_DATA_PACKET;
+    else
+      *type = HCI_ACL_DATA_PACKET;
+    return true;
+  case BTSNOOP_H4:
+    if (*len < 1)
+      return false;
+    *to_host = flags & BTSNOOP_FLAG_RECEIVED;
+    *type = (*data)[0];
+    (*data)++;
+    (*len)--;
+    return true;
+  case BTSNOOP_MONITOR:
+    switch (flags & 0xFFFF) { // btmon opcode
+    case 2:
+      *type = HCI_COMMAND_DATA_PACKET, *to_host = false;
+      return true;
+    case 3:
+      *type = HCI_EVENT_PACKET, *to_host = true;
+      return true;
+    case 4:
+    case 5:
+      *type = HCI_ACL_DATA_PACKET, *to_host = (flags & 0xFFFF) == 5;
+      return true;
+    case 6:
+    case 7:
+      *type = HCI_SCO_DATA_PACKET, *to_host = (flags & 0xFFFF) == 7;
+      return true;
+    default:
+      return false;
+    }
+  default:
+    return false;
+  }
+}
+
+static record_t *load_btsnoop(const char *path, size_t *n_out) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    perror(path);
+    exit(1);
+  }
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  uint8_t *buf = malloc(size > 0 ? (size_t)size : 1);
+  if (!buf || fread(buf, 1, (size_t)size, f) != (size_t)size) {
+    fprintf(stderr, "%s: read failed\n", path);
+    exit(1);
+  }
+  fclose(f);
+
+  if (size < 16 || memcmp(buf, "btsnoop\0", 8) != 0) {
+    fprintf(stderr, "%s: not a btsnoop file\n", path);
+    exit(1);
+  }
+  uint32_t datalink = be32(&buf[12]);
+  if (datalink != BTSNOOP_H1 && datalink != BTSNOOP_H4 &&
+      datalink != BTSNOOP_MONITOR) {
+    fprintf(stderr, "%s: unsupported datalink %u\n", path, datalink);
+    exit(1);
+  }
+
+  size_t cap = 1024, n = 0;
+  record_t *recs = malloc(cap * sizeof(record_t));
+  long off = 16;
+  uint64_t t0 = 0;
+  while (recs && off + 24 <= size) {
+    const uint8_t *h = &buf[off];
+    uint32_t incl = be32(&h[4]);
+    uint32_t flags = be32(&h[8]);
+    uint64_t ts = ((uint64_t)be32(&h[16]) << 32) | be32(&h[20]);
+    off += 24;
+    if (off + (long)incl > size)
+      break; // Truncated capture
+    const uint8_t *data = &buf[off];
+    off += incl;
+
+    uint8_t type;
+    bool to_host;
+    if (!classify(datalink, flags, &data, &incl, &type, &to_host) ||
+        incl == 0 || incl > HCI_PACKET_MAX_SIZE) {
+      n_skipped++;
+      continue;
+    }
+    if (n == 0)
+      t0 = ts;
+    if (n == cap) {
+      cap *= 2;
+      recs = realloc(recs, cap * sizeof(record_t));
+      if (!recs)
+        break;
+    }
+    recs[n++] = (record_t){.ts = ts - t0,
+                           .to_host = to_host,
+                           .type = type,
+                           .len = (uint16_t)incl,
+                           .data = data};
+  }
+  if (!recs) {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+  // buf stays allocated: records point into it
+  *n_out = n;
+  return recs;
+}
+
+// --- Replay ---
+
+static void deliver(const record_t *r) {
+  static uint8_t pkt[HCI_PACKET_MAX_SIZE];
+  memcpy(pkt, r->data, r->len);
+
+  if (r->to_host) {
+    hci_packet_handler(r->type, pkt, r->len);
+  } else if (r->type == HCI_COMMAND_DATA_PACKET) {
+    tud_bt_hci_cmd_cb(pkt, r->len);
+  } else if (r->type == HCI_ACL_DATA_PACKET) {
+    for (uint16_t o = 0; o < r->len; o += USB_BULK_CHUNK) {
+      uint16_t n = r->len - o < USB_BULK_CHUNK ? r->len - o : USB_BULK_CHUNK;
+      tud_bt_acl_data_received_cb(&pkt[o], n);
+    }
+  } else {
+    n_sco++;
+  }
+}
+
+// As-fast-as-possible mode: a direction accepts input while its queue is
+// below half full
+static bool can_deliver(const record_t *r) {
+  uint8_t rx, tx, txp;
+  hci_packet_queue_get_depths(&rx, &tx, &txp);
+  if (r->to_host)
+    return rx < HCI_PACKET_QUEUE_SIZE / 2;
+  return tx < HCI_PACKET_QUEUE_SIZE / 2 &&
+         txp < HCI_PACKET_PRIO_QUEUE_SIZE / 2;
+}
+
+static void print_dir(const char *name, dir_t *d, double secs,
+                      const queue_direction_stats_t *q) {
+  qsort(d->lat.v, d->lat.n, sizeof(uint32_t), cmp_u32);
+  printf("%-10s : Pkts=%u  %.2f KB/s  Drops=%u (Crit=%u ACL=%u Disc=%u)  "
+         "Peak=%u\n",
+         name, d->pkts, secs > 0 ? (double)d->bytes / 1024.0 / secs : 0.0,
+         q->drops, q->class_drops[HCI_CLASS_CRITICAL],
+         q->class_drops[HCI_CLASS_ACL], q->class_drops[HCI_CLASS_DISCARDABLE],
+         q->peak_depth);
+  printf("%-10s : Latency p50=%u p90=%u p99=%u max=%u us\n", name,
+         percentile(&d->lat, 50), percentile(&d->lat, 90),
+         percentile(&d->lat, 99), d->lat.n ? d->lat.v[d->lat.n - 1] : 0);
+}
+
+static void usage(void) {
+  fprintf(stderr, "usage: hci_replay [-s SPEED | -f] [-a] [-c US,NS] "
+                  "[-u US,NS] [-t dual|swapped|single] capture.btsnoop\n");
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  double speed = 1.0;
+  bool fast = false;
+  bool adv = false;
+  unsigned cyw_pkt_us = 20, cyw_byte_ns = 160; // gSPI ~50 MHz
+  unsigned usb_pkt_us = 10, usb_byte_ns = 1000; // USB FS bulk/interrupt
+  const char *topology = "dual";
+  const char *path = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+      speed = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "-f")) {
+      fast = true;
+    } else if (!strcmp(argv[i], "-a")) {
+      adv = true;
+    } else if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+      if (sscanf(argv[++i], "%u,%u", &cyw_pkt_us, &cyw_byte_ns) != 2)
+        usage();
+    } else if (!strcmp(argv[i], "-u") && i + 1 < argc) {
+      if (sscanf(argv[++i], "%u,%u", &usb_pkt_us, &usb_byte_ns) != 2)
+        usage();
+    } else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+      topology = argv[++i];
+      if (strcmp(topology, "dual") && strcmp(topology, "swapped") &&
+          strcmp(topology, "single"))
+        usage();
+    } else if (argv[i][0] != '-' && !path) {
+      path = argv[i];
+    } else {
+      usage();
+    }
+  }
+  if (!path || speed <= 0)
+    usage();
+
+  size_t n;
+  record_t *recs = load_btsnoop(path, &n);
+
+  hci_packet_queue_init();
+  adv_filter_init();
+  adv_filter_set_enabled(adv);
+  bt_a2dp_init();
+  hci_stats_init();
+
+  size_t next = 0;
+  uint64_t tx_busy_until = 0, rx_busy_until = 0;
+  bool single = !strcmp(topology, "single");
+  unsigned tx_run = 0; // Single core: TX packets since the last RX turn
+
+  for (;;) {
+    // Input
+    while (next < n) {
+      const record_t *r = &recs[next];
+      if (fast ? !can_deliver(r)
+               : (uint64_t)((double)r->ts / speed) > replay_now_us)
+        break;
+      deliver(r);
+      next++;
+    }
+    if (adv_filter_flush_due())
+      adv_filter_flush();
+
+    // Core 0: TX drain (single core: yields to RX after a batch)
+    bool rx_turn = single && tx_run >= TX_BATCH_MAX && hci_rx_peek();
+    if (replay_now_us >= tx_busy_until && !rx_turn) {
+      bool prio;
+      hci_packet_entry_t *e = bt_a2dp_tx_next(&prio);
+      if (e) {
+        tx_busy_until = replay_now_us + cyw_pkt_us +
+                        (uint64_t)e->size * cyw_byte_ns / 1000;
+        if (single) {
+          rx_busy_until = tx_busy_until;
+          tx_run++;
+        }
+        sample_add(&tx_dir.lat, (uint32_t)tx_busy_until - e->enq_us);
+        tx_dir.pkts++;
+        tx_dir.bytes += e->size;
+        hci_stats_tx_sent(e);
+        bt_a2dp_tx_free(e, prio);
+      }
+    }
+    bool tx_pending = hci_tx_peek() || hci_tx_prio_peek();
+
+    // Core 1: RX drain
+    if (replay_now_us >= rx_busy_until) {
+      hci_packet_entry_t *e = hci_rx_peek();
+      if (e) {
+        rx_busy_until = replay_now_us + usb_pkt_us +
+                        (uint64_t)e->size * usb_byte_ns / 1000;
+        if (single) {
+          tx_busy_until = rx_busy_until;
+          tx_run = 0;
+        }
+        sample_add(&rx_dir.lat, (uint32_t)rx_busy_until - e->enq_us);
+        rx_dir.pkts++;
+        rx_dir.bytes += e->size;
+        hci_stats_rx_sent(e);
+        hci_rx_free();
+      }
+    }
+    bool rx_pending = hci_rx_peek() != NULL;
+
+    bool busy = tx_busy_until > replay_now_us || rx_busy_until > replay_now_us;
+    if (next >= n && !tx_pending && !rx_pending && !busy)
+      break;
+
+    // Advance virtual time to the next thing that can happen
+    uint64_t t = replay_now_us + MAX_STEP_US;
+    if (!fast && next < n) {
+      uint64_t due = (uint64_t)((double)recs[next].ts / speed);
+      if (due < t)
+        t = due;
+    }
+    if (tx_pending && tx_busy_until < t)
+      t = tx_busy_until;
+    if (rx_pending && rx_busy_until < t)
+      t = rx_busy_until;
+    if (t <= replay_now_us) {
+      if (tx_pending || rx_pending || (fast && next < n))
+        continue; // A consumer is free now
+      t = replay_now_us + 1;
+    }
+    replay_now_us = t;
+  }
+  adv_filter_flush();
+
+  double secs = (double)replay_now_us / 1e6;
+  queue_stats_t qs;
+  hci_packet_queue_get_stats_and_reset(&qs);
+  queue_direction_stats_t tx_q = qs.tx;
+  tx_q.drops += qs.tx_prio.drops;
+  tx_q.class_drops[HCI_CLASS_ACL] += qs.tx_prio.class_drops[HCI_CLASS_ACL];
+
+  printf("=== HCI REPLAY: %s ===\n", path);
+  printf("RECORDS    : %zu replayed  SCO=%u (not replayed)  Skipped=%u\n", n,
+         n_sco, n_skipped);
+  if (fast)
+    printf("MODE       : as fast as possible\n");
+  else
+    printf("MODE       : timed x%.2f\n", speed);
+  printf("MODEL      : CYW43 %u us + %u ns/B  USB %u us + %u ns/B  "
+         "(topology %s, queues %u/%u, adv filter %s, A2DP sched %s)\n",
+         cyw_pkt_us, cyw_byte_ns, usb_pkt_us, usb_byte_ns, topology,
+         HCI_PACKET_QUEUE_SIZE, HCI_PACKET_PRIO_QUEUE_SIZE,
+         adv ? "on" : "off", DONGLE_A2DP_SCHED ? "on" : "off");
+  printf("DURATION   : %.3f s (virtual)\n", secs);
+  print_dir("TX", &tx_dir, secs, &tx_q);
+  printf("TX PRIO    : Peak=%u\n", qs.tx_prio.peak_depth);
+  print_dir("RX", &rx_dir, secs, &qs.rx);
+
+  adv_filter_stats_t af;
+  adv_filter_get_stats_and_reset(&af);
+  if (af.events_in > 0)
+    printf("ADV FILTER : Events In=%u Out=%u  Reports=%u Dup=%u\n",
+           af.events_in, af.events_out, af.reports_in, af.suppressed);
+
+  static hci_stats_t hs;
+  hci_stats_get_and_reset(&hs);
+  for (int i = 0; i < HCI_STATS_MAX_CONNS; i++) {
+    const hci_conn_stats_t *c = &hs.conns[i];
+    if (c->rx.pkts + c->tx.pkts + c->rx.drops + c->tx.drops == 0)
+      continue;
+    printf("CONN 0x%03X : RX=%u pkts %u B Drop=%u  TX=%u pkts %u B Drop=%u\n",
+           c->handle, c->rx.pkts, c->rx.bytes, c->rx.drops, c->tx.pkts,
+           c->tx.bytes, c->tx.drops);
+  }
+  printf("USB ERR    : Reassembly Resets=%u\n",
+         bt_hci_get_reassembly_errors());
+  return 0;
+}
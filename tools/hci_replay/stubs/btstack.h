@@ -0,0 +1,24 @@
+// btstack.h - Host stub of the BTstack definitions used by the HCI path
+#ifndef REPLAY_BTSTACK_H
+#define REPLAY_BTSTACK_H
+
+#include "pico.h"
+
+#define HCI_COMMAND_DATA_PACKET 0x01
+#define HCI_ACL_DATA_PACKET 0x02
+#define HCI_SCO_DATA_PACKET 0x03
+#define HCI_EVENT_PACKET 0x04
+
+typedef struct {
+  const char *name;
+  void (*init)(const void *transport_config);
+  int (*open)(void);
+  int (*close)(void);
+  void (*register_packet_handler)(void (*handler)(uint8_t packet_type,
+                                                  uint8_t *packet,
+                                                  uint16_t size));
+  int (*can_send_packet_now)(uint8_t packet_type);
+  int (*send_packet)(uint8_t packet_type, uint8_t *packet, int size);
+} hci_transport_t;
+
+#endif // REPLAY_BTSTACK_H
@@ -0,0 +1,10 @@
+// sync.h - Host stub for hci_replay (single-threaded, no interrupts)
+#ifndef REPLAY_HARDWARE_SYNC_H
+#define REPLAY_HARDWARE_SYNC_H
+
+#include "pico.h"
+
+static inline uint32_t save_and_disable_interrupts(void) { return 0; }
+static inline void restore_interrupts(uint32_t flags) { (void)flags; }
+
+#endif // REPLAY_HARDWARE_SYNC_H
@@ -0,0 +1,12 @@
+// timer.h - Host stub for hci_replay: time is the replay's virtual clock
+#ifndef REPLAY_HARDWARE_TIMER_H
+#define REPLAY_HARDWARE_TIMER_H
+
+#include "pico.h"
+
+extern uint64_t replay_now_us;
+
+static inline uint64_t time_us_64(void) { return replay_now_us; }
+static inline uint32_t time_us_32(void) { return (uint32_t)replay_now_us; }
+
+#endif // REPLAY_HARDWARE_TIMER_H
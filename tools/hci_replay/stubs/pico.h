@@ -0,0 +1,20 @@
+// pico.h - Host stub of the Pico SDK base header for hci_replay
+#ifndef REPLAY_PICO_H
+#define REPLAY_PICO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef unsigned int uint;
+
+#define __not_in_flash_func(f) f
+#define __scratch_x(group)
+#define __scratch_y(group)
+#define NUM_CORES 2
+#define count_of(a) (sizeof(a) / sizeof((a)[0]))
+
+// Single-threaded replay: barriers only need to stop compiler reordering
+static inline void __dmb(void) { __asm__ volatile("" ::: "memory"); }
+
+#endif // REPLAY_PICO_H
@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+"""Convert a dongle trace dump (UART log) to Chrome/Perfetto trace JSON.
+
+Usage:
+    trace_to_perfetto.py uart_log.txt > trace.json
+
+Open the result in https://ui.perfetto.dev or chrome://tracing.
+Only lines between "TR BEGIN" and "TR END" are used; other UART output
+(stats reports, etc.) may be interleaved.
+"""
+import json
+import sys
+
+# Must match trace_event_id_t in src/trace.h
+EVENTS = {
+    1: ("rx_enqueue", "i"),
+    2: ("rx_dequeue", "i"),
+    3: ("tx_enqueue", "i"),
+    4: ("tx_dequeue", "i"),
+    5: ("queue_drop", "i"),
+    6: ("send_packet", "B"),
+    7: ("send_packet", "E"),
+    8: ("tud_task", "B"),
+    9: ("tud_task", "E"),
+    10: ("usb_send", "i"),
+    11: ("sco_frame", "i"),
+    12: ("stats_print", "B"),
+    13: ("stats_print", "E"),
+    14: ("trigger", "i"),
+    15: ("sco_level", "C"),
+}
+
+CORE_NAMES = {0: "Core 0 (CYW43/TX)", 1: "Core 1 (USB/RX)"}
+
+
+def parse(lines):
+    """Return (core, ts_us, event_id, arg) for the last complete dump."""
+    dump, last = None, None
+    for line in lines:
+        line = line.strip()
+        if line.startswith("TR BEGIN"):
+            dump = []
+        elif line == "TR END":
+            if dump is not None:
+                last = dump
+            dump = None
+        elif line.startswith("TR ") and dump is not None:
+            parts = line.split()
+            if len(parts) != 4:
+                continue
+            core, ts, tag = int(parts[1]), int(parts[2], 16), int(parts[3], 16)
+            dump.append((core, ts, tag & 0xFF, tag >> 8))
+    if last is None:
+        sys.exit("no complete 'TR BEGIN' ... 'TR END' dump found")
+    return last
+
+
+def unwrap(events):
+    """time_us_32() wraps every ~71 minutes; make each core monotonic."""
+    out, offset, prev = [], {}, {}
+    for core, ts, ev, arg in events:
+        if core in prev and ts < prev[core] and prev[core] - ts > 0x80000000:
+            offset[core] = offset.get(core, 0) + (1 << 32)
+        prev[core] = ts
+        out.append((core, ts + offset.get(core, 0), ev, arg))
+    return out
+
+
+def convert(events):
+    events = unwrap(events)
+    t0 = min(ts for _, ts, _, _ in events) if events else 0
+    trace = []
+    for core, name in CORE_NAMES.items():
+        trace.append({"ph": "M", "name": "thread_name", "pid": 0, "tid": core,
+                      "args": {"name": name}})
+    for core, ts, ev, arg in events:
+        name, ph = EVENTS.get(ev, ("ev%d" % ev, "i"))
+        rec = {"name": name, "ph": ph, "ts": ts - t0, "pid": 0, "tid": core}
+        if ph == "i":
+            rec["s"] = "t"
+        if ph == "C":
+            rec["args"] = {"packets": arg}
+        elif ph != "E":
+            rec["args"] = {"arg": arg}
+        trace.append(rec)
+    return {"traceEvents": trace, "displayTimeUnit": "ms"}
+
+
+def main():
+    if len(sys.argv) > 1:
+        with open(sys.argv[1], errors="replace") as f:
+            events = parse(f)
+    else:
+        events = parse(sys.stdin)
+    json.dump(convert(events), sys.stdout)
+
+
+if __name__ == "__main__":
+    main()